@@ -0,0 +1,58 @@
+#ifndef ACTOR_H
+#define ACTOR_H
+
+#include "server.h"
+
+/*
+Each session's game is an actor: its board, command queue and tick state
+are only touched by session_actor_step(), and at most one step runs at a
+time (on an executor worker). The session's reader coroutine posts the
+client's requests to the mailbox and notifies the actor; the ticker
+activates it when a ghost tick is due.
+
+actor_state moves between:
+  ACTOR_OFF      no game (before actor_start, after actor_stop)
+  ACTOR_IDLE     waiting for mail or its tick deadline
+  ACTOR_RUNNING  claimed by whoever scheduled the step, until it returns
+  ACTOR_PARKED   held by a checkpoint while the process forks
+Only an IDLE actor can be claimed, so claiming is a single CAS.
+*/
+#define ACTOR_OFF 0
+#define ACTOR_IDLE 1
+#define ACTOR_RUNNING 2
+#define ACTOR_PARKED 3
+
+/*Reader: starts the actor on the loaded board (its first tick one tempo from now)*/
+void actor_start(session_t *sess);
+
+/*
+Reader: stops the actor, waiting for a step in progress or a checkpoint.
+Afterwards the reader owns the board again
+*/
+void actor_stop(session_t *sess);
+
+/*Reader: queues a request. Returns -1 when the mailbox is full*/
+int actor_post(session_t *sess, const mail_t *mail);
+
+/*Actor: takes the next request. Returns 0 when the mailbox is empty*/
+int actor_take(session_t *sess, mail_t *mail);
+
+/*Schedules a step if the actor is idle with mail waiting*/
+void actor_notify(session_t *sess);
+
+/*IDLE -> RUNNING. Returns 1 when the caller now has to run actor_run()*/
+int actor_claim(session_t *sess);
+
+/*Runs one step of a claimed actor and makes it idle again*/
+void actor_run(session_t *sess);
+
+/*
+Checkpoints: holds an idle actor so no step starts until actor_unpark.
+A step in progress gets up to timeout_ms to end (0 only tries once).
+Returns 1 when parked, 0 for a session without a running game and -1
+when the step is still running
+*/
+int actor_park(session_t *sess, int timeout_ms);
+void actor_unpark(session_t *sess);
+
+#endif
@@ -8,15 +8,113 @@ typedef struct {
   int victory;
   int game_over;
   int accumulated_points;
+  int ack_seq; // Last tagged play or batch applied by the server (-1 for untagged sessions)
+  int dropped_commands; // Batched commands the server's full queue turned away (tagged sessions only)
   char* data;
 } Board;
 
-int pacman_connect(char const *req_pipe_path, char const *notif_pipe_path, char const *server_pipe_path);
+/*
+Each connection is an opaque handle owning its pipes and frame buffers, so
+one process can hold many sessions (one handle per game). Calls on
+different handles are independent; a handle may be shared by a sender and
+a receiver thread. Only one call decodes frames at a time: the others
+(pacman_disconnect included) wait for it to return.
+*/
+typedef struct Session pacman_session_t;
 
-void pacman_play(char command);
+/*
+Optional event callbacks, run by pacman_poll/pacman_receive_frame on the
+receiving thread as frames are decoded. The Board is valid only for the
+duration of the call. Any member may be NULL. A callback must not receive
+(pacman_poll returns 0, pacman_receive_frame -1); pacman_disconnect from a
+callback only sends the request, the acknowledgement ends the poll in
+progress and pacman_close releases the pipes.
+*/
+typedef struct {
+  void (*on_board)(const Board *board, void *user_data);
+  void (*on_victory)(const Board *board, void *user_data);   // Victory flag was raised
+  void (*on_game_over)(const Board *board, void *user_data);
+  void (*on_disconnect)(void *user_data);                    // Stream is over, no more frames
+} pacman_callbacks_t;
+
+/*Connects to the server and waits for a slot. Returns NULL on failure*/
+pacman_session_t *pacman_open(char const *req_pipe_path, char const *notif_pipe_path, char const *server_pipe_path);
+
+/*
+Admin request: sets how many games the server accepts at once. Growing
+starts serving queued clients right away; shrinking lets the games above
+the new limit finish. Written to the server's admin pipe (the registry
+path plus ADMIN_PIPE_SUFFIX), so it needs the server's user. The server
+refuses to grow past a few times the max_games it was started with.
+Returns 0 once the request is written
+*/
+int pacman_admin_resize(char const *server_pipe_path, int max_games);
+
+void pacman_play(pacman_session_t *h, char command);
+
+/*
+Sends a whole script of commands in as few messages as possible
+(MAX_BATCH_COMMANDS per message). The server queues them and plays one
+per pacman turn. Returns 0 on success.
+*/
+int pacman_play_batch(pacman_session_t *h, const char *cmds, int n);
+
+/*
+pacman_play_batch whose last command is tagged with seq: frames report it
+in ack_seq once that command was played, so the next batch can be sent
+when the server is about to run out instead of on a client-side timer
+*/
+int pacman_play_batch_seq(pacman_session_t *h, const char *cmds, int n, int seq);
+
+// Same as pacman_play but tagged with a sequence number the server acknowledges in each frame
+void pacman_play_seq(pacman_session_t *h, char command, int seq);
+
+/*
+Sends the disconnect request, reads frames up to its acknowledgement and
+closes the pipes; the handle stays valid until pacman_close. A receive in
+progress on another thread is let finish first (it returns on the next
+frame or the acknowledgement), later receives return -1
+*/
+int pacman_disconnect(pacman_session_t *h);
+
+/*Disconnects if still connected and frees the handle*/
+void pacman_close(pacman_session_t *h);
+
+/*
+Pipe descriptors, so many handles can be multiplexed with poll/epoll on one
+thread: wait for the notification fd to be readable, then receive a frame.
+Both are -1 once disconnected.
+*/
+int pacman_request_fd(pacman_session_t *h);
+int pacman_notification_fd(pacman_session_t *h);
+
+/*
+Non-blocking receive for event loops: waits up to timeout_ms (0 to just
+check, -1 forever) for the notification fd, then decodes every complete
+frame already received. Partial messages are kept until the rest arrives.
+Returns the number of frames decoded, or -1 once the connection is over.
+*/
+int pacman_poll(pacman_session_t *h, int timeout_ms);
+
+void pacman_set_callbacks(pacman_session_t *h, const pacman_callbacks_t *callbacks, void *user_data);
+
+// Returns a malloc'd copy of the next frame (caller frees data)
+Board receive_board_update(pacman_session_t *h);
+
+/*
+Zero allocation receive path: decodes the next frame into the session's
+back buffer and publishes it by swapping buffers under the frame mutex.
+Returns 0 on success, -1 once the connection is closed.
+*/
+int pacman_receive_frame(pacman_session_t *h);
 
-int pacman_disconnect();
+/*
+Borrows the last published frame (NULL if none arrived yet). The frame is
+valid until pacman_release_board(); keep the borrow short, the receiver
+waits for it before publishing the next frame.
+*/
+const Board* pacman_borrow_board(pacman_session_t *h);
 
-Board receive_board_update(void);
+void pacman_release_board(pacman_session_t *h);
 
-#endif
\ No newline at end of file
+#endif
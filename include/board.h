@@ -7,6 +7,7 @@
 #define MAX_GHOSTS 25
 
 #include <pthread.h>
+#include <stdint.h>
 
 typedef enum {
     REACHED_PORTAL = 1,
@@ -18,7 +19,6 @@ typedef enum {
 typedef struct {
     char command;
     int turns;
-    int turns_left;
 } command_t;
 
 typedef struct {
@@ -26,29 +26,53 @@ typedef struct {
     int alive; // if is alive
     int points; // how many points have been collected
     int passo; // number of plays to wait before starting
-    command_t moves[MAX_MOVES];
+    const command_t *moves; // script shared with the level (NULL when controlled by input)
     int current_move;
     int n_moves;
     int waiting;
+    int turns_left; // turns left in the current 'T' move (0 when not waiting)
 } pacman_t;
 
 typedef struct {
     int pos_x, pos_y; //current position
     int passo; // number of plays to wait before starting
-    command_t moves[MAX_MOVES];
+    const command_t *moves; // script shared with the level
     int n_moves;
     int current_move;
     int waiting;
     int charged;
+    int turns_left; // turns left in the current 'T' move (0 when not waiting)
 } ghost_t;
 
 typedef struct {
     char content; // stuff like 'P' for pacman 'M' for monster and 'W' for wall
-    int has_dot; // whether there is a dot in this position or not
-    int has_portal; // whether there is a portal in this position or not
-    pthread_mutex_t lock;
+    char has_dot; // whether there is a dot in this position or not
+    char has_portal; // whether there is a portal in this position or not
 } board_pos_t;
 
+/*
+Static data of a level, parsed once and shared read-only by every board that
+plays it (the server keeps one per level file for all its sessions). Boards
+only hold what changes while playing and a reference to their level; the
+last level_release frees it.
+*/
+typedef struct {
+    _Atomic int refs;
+    char name[MAX_FILENAME]; // level file without the extension
+    char pacman_file[MAX_FILENAME]; // file with pacman movements (empty when there is none)
+    char ghosts_files[MAX_GHOSTS][MAX_FILENAME]; // files with monster movements
+    int width, height;
+    int tempo;
+    char *grid; // 'W' wall, '@' portal, '.' dot, ' ' empty, row-major
+    int n_pacmans;
+    pacman_t *pacmans; // starting state of every pacman (no script, see read_pacman_moves)
+    int n_ghosts;
+    ghost_t *ghosts; // starting state of every ghost, moves point to ghost_scripts
+    command_t pacman_script[MAX_MOVES]; // moves of the .p file
+    int pacman_script_len;
+    command_t (*ghost_scripts)[MAX_MOVES];
+} level_t;
+
 typedef struct {
     int width, height; //dimensions of the board
     board_pos_t* board; //actual board, most likely a row-major matrix
@@ -56,19 +80,46 @@ typedef struct {
     pacman_t* pacmans; // array containing every pacman in the board to iterate through when processing
     int n_ghosts; //number of ghosts in the board
     ghost_t* ghosts; // array containing every ghost in the board to iterate through when processing
-    char level_name[256]; //name for the level file to keep track of which will be the next
-    char pacman_file[256]; // file with pacman movements
-    char ghosts_files[MAX_GHOSTS][256]; // files with monster movements
+    level_t* level; // shared static data (NULL for boards rebuilt from frames by the client)
     int tempo; 
+    uint64_t seed; // seed of the random generator, kept for replays and tests
+    _Atomic uint64_t rng_state; // private SplitMix64 counter used for 'R' moves
     pthread_rwlock_t state_lock;
+    pthread_mutex_t* cell_locks; // one per cell when several threads move the board, NULL otherwise
 } board_t;
 
 /*Move pacman/monster in a certain direction on the board must check for boundaries, walls and other monsters
 Maybe do 1 function for pacman and 1 for monsters if required
 Maybe do 1 function for each direction
 */
-int move_pacman(board_t* board, int pacman_index, command_t* command);
-int move_ghost(board_t* board, int ghost_index, command_t* command);
+int move_pacman(board_t* board, int pacman_index, const command_t* command);
+int move_ghost(board_t* board, int ghost_index, const command_t* command);
+
+/*Seeds the board's private random generator (used by 'R' moves)*/
+void seed_board_rng(board_t* board, uint64_t seed);
+
+/*Seed of the level-th level (0 based) of a game seeded with seed, so 'R' ghosts do not repeat themselves across levels*/
+uint64_t level_seed(uint64_t seed, int level);
+
+/*Advances every scripted ghost by one tick, returns DEAD_PACMAN if one of them killed a pacman*/
+int move_ghosts(board_t* board);
+
+/*
+Number of the next ghost ticks (at most limit) that would leave the board as
+it is: every scripted ghost is in a passo wait, a 'T' or a 'C'. Pacmans are
+not considered, callers know whether input is pending
+*/
+int board_quiet_ticks(const board_t* board, int limit);
+
+/*Plays ticks quiet ticks at once (at most what board_quiet_ticks returned)*/
+void board_skip_ticks(board_t* board, int ticks);
+
+/*
+Advances the whole board by one tick: pacman 0 plays pacman_command (skipped
+when NULL), then every scripted ghost moves. Waiting (passo) is handled by
+the move functions. Returns REACHED_PORTAL, DEAD_PACMAN or VALID_MOVE
+*/
+int board_step(board_t* board, const command_t* pacman_command);
 
 /*Remove an object (Pacman)*/
 void kill_pacman(board_t* board, int pacman_index);
@@ -80,13 +131,65 @@ int load_pacman(board_t* board);
 int load_ghost(board_t* board);
 
 
+/*Parses a level file and the entity files it names. Returns NULL on failure*/
+level_t* level_load(char* filename, char* dirname);
+
+void level_retain(level_t* level);
+
+/*Drops a reference, the last one frees the level*/
+void level_release(level_t* level);
+
+/*
+Allocates a board playing level (which it keeps a reference to) and puts it
+in the starting state with the pacman holding accumulated_points
+*/
+int board_init(board_t* board, level_t* level, int accumulated_points);
+
+/*Puts an initialized board back in its level's starting state, without allocating*/
+void board_reset(board_t* board, int accumulated_points);
+
+/*
+Long-lived storage for one board at a time: cells, pacmans and ghosts sized
+for the largest level it will hold. Loading a level only copies its starting
+state in, so a board can move from level to level, or game to game, without
+malloc or lock init/destroy. Arena boards have a single writer, they never
+get cell locks.
+*/
+typedef struct {
+    board_t board;
+    int cells_capacity;
+    int pacmans_capacity;
+    int ghosts_capacity;
+} board_arena_t;
+
+int board_arena_init(board_arena_t* arena, int cells, int n_pacmans, int n_ghosts);
+void board_arena_destroy(board_arena_t* arena);
+
+/*
+Sets the arena's board up to play level (taking a reference to it).
+Returns NULL if the level does not fit
+*/
+board_t* board_arena_load(board_arena_t* arena, level_t* level, int accumulated_points);
+
+/*Drops the level of the arena's board, the memory stays for the next load*/
+void board_arena_unload(board_arena_t* arena);
+
 /*
 Fils the board with the information coming from the file
+(level_load + board_init, the board holds the only reference)
 */
 int load_level(board_t* board, char* filename, char* dirname, int accumulated_points);
-// Unloads levels loaded by load_level
+// Unloads boards set up by load_level or board_init
 void unload_level(board_t * board);
 
+/*
+Gives a board set up by load_level or board_init a mutex per cell, for the
+standalone game whose pacman and ghost threads move it at the same time.
+Boards without them have a single writer and skip cell locking.
+Returns 0 on success
+*/
+int board_enable_cell_locks(board_t* board);
+
 // DEBUG FILE
 
 void open_debug_file(char *filename);
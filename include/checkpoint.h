@@ -0,0 +1,31 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <sys/types.h>
+
+#define CHECKPOINT_MAGIC "PCKP"
+#define CHECKPOINT_VERSION 3
+#define DEFAULT_CHECKPOINT_FILE "server.ckpt"
+// Safety net: steps never wait for clients, a step still running after this is stuck
+#define CHECKPOINT_PARK_MS 1000
+
+// Checkpoint settings (interval 0 disables periodic checkpoints)
+extern int checkpoint_interval_ms;
+extern char checkpoint_file[256];
+
+/*
+Freezes every session for the duration of a fork() and lets the child
+serialize the copy-on-write sessions/boards to disk. Steps in progress are
+waited for; one still running after CHECKPOINT_PARK_MS is left out and its
+session id listed in the header. Returns the child pid, or -1 if the fork
+failed or a previous checkpoint is still being written.
+*/
+pid_t checkpoint_start(const char *path);
+
+// Reaps a finished checkpoint child without blocking (returns 1 when one was reaped)
+int checkpoint_poll(void);
+
+// Thread that triggers a checkpoint every checkpoint_interval_ms
+void* checkpoint_thread(void* arg);
+
+#endif
@@ -0,0 +1,77 @@
+#ifndef CORO_H
+#define CORO_H
+
+/*
+Stackful coroutines for the session handlers. A few loop threads each run
+the coroutines spawned on them (a coroutine never moves to another loop)
+and sleep in epoll until a pipe they wait on is ready or a timer expires.
+Stacks are mapped lazily, so an idle session costs the pages its handler
+touched, not a thread stack.
+
+A coroutine must not hold a lock across coro_wait_fd / coro_sleep_ms, and
+must not wait for a lock other threads hold for long (session_lock, the
+recorder): that work goes to the executor, which may block.
+*/
+#define CORO_STACK_SIZE (64 * 1024)   // Reserved per coroutine, plus a guard page
+#define CORO_MAX_EVENTS 64            // Events taken per epoll_wait
+
+typedef void (*coro_fn_t)(void *arg);
+typedef struct coro coro_t;
+
+/*
+Starts n_loops loop threads (<= 0 for one per online core). Returns 0 on
+success; on failure the loops already started are stopped and released
+*/
+int coro_runtime_start(int n_loops);
+
+/*Waits for every coroutine to return, then joins the loops*/
+void coro_runtime_stop(void);
+
+/*Runs fn(arg) as a coroutine on one of the loops. Returns 0 on success*/
+int coro_spawn(coro_fn_t fn, void *arg);
+
+/*1 when called from a coroutine*/
+int coro_active(void);
+
+/*The calling coroutine (NULL outside one)*/
+coro_t* coro_self(void);
+
+/*
+Suspends the coroutine until fd is ready for events (POLLIN / POLLOUT) or
+timeout_ms passes (-1 waits forever). Returns 1 when ready, 0 on timeout
+and -1 without waiting if the timeout could not be armed (out of memory).
+Outside a coroutine it is a plain poll()
+*/
+int coro_wait_fd(int fd, short events, int timeout_ms);
+
+/*
+Suspends the coroutine for ms (sleep_ms outside a coroutine). Returns 0,
+or -1 at once if the timer could not be armed (out of memory): the caller
+retries or gives up, the loop thread never sleeps for it
+*/
+int coro_sleep_ms(int ms);
+
+/*
+Long-lived waits: fd is registered once for the calling coroutine
+(edge-triggered, so the coroutine reads or writes until EAGAIN before it
+waits again) and stays registered until coro_unwatch_fd, which must be
+called before fd is closed. Returns 0 on success, -1 outside a coroutine
+*/
+int coro_watch_fd(int fd, short events);
+void coro_unwatch_fd(int fd);
+
+/*
+Suspends the coroutine until one of its watched fds has an event or
+coro_wake is called. Returns at once if that happened since the last wait.
+Stopping the runtime wakes every waiting coroutine
+*/
+void coro_wait(void);
+
+/*
+Any thread: wakes c from coro_wait (or makes its next coro_wait return).
+The caller must know c has not returned yet; a wake still queued when it
+does is dropped safely
+*/
+void coro_wake(coro_t *c);
+
+#endif
@@ -17,10 +17,20 @@ Potential Structures for ncurses
 /*Initialize everything ncurses requires*/
 int terminal_init();
 
+/*Draws a client frame, only re-emitting cells that changed since the previous call*/
 void draw_board_client(Board board);
 
+/*Same as draw_board_client with a custom status line (only redrawn after display_invalidate)*/
+void draw_board_frame(Board board, const char *menu);
+
+/*Forces the next draw_board_client to repaint the whole board*/
+void display_invalidate();
+
 char* get_board_displayed(board_t* board);
 
+/*Same as get_board_displayed, into a caller buffer of width*height+1 chars*/
+void fill_board_displayed(board_t* board, char* output);
+
 /*Draw the board on the screen*/
 void draw_board(board_t* board, int mode);
 
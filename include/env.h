@@ -0,0 +1,52 @@
+#ifndef ENV_H
+#define ENV_H
+
+#include <stdint.h>
+
+/*
+Batched environment for training bots without the server: N copies of one
+level are stepped together, each with its own action, on a persistent pool
+of worker threads. Observations are written to a caller buffer of
+n_envs * env_observation_size() chars, in the characters of the client
+frames ('#', 'C', 'M', '.', '@', ' ') plus 'G' for a charged ghost, which
+the server shows as 'M'. Stepping never allocates.
+*/
+typedef struct pacman_env pacman_env_t;
+
+typedef enum {
+    ENV_RUNNING = 0,
+    ENV_WON = 1,        // Pacman reached the portal
+    ENV_DIED = 2,       // Pacman was caught by a ghost
+    ENV_TRUNCATED = 3,  // max_steps reached
+} env_status_t;
+
+/*
+Loads level_file from level_dir once as a template and clones it n_envs
+times. Env i uses seed + i for its 'R' moves. max_steps truncates episodes
+(0 for no limit). n_threads includes the calling thread.
+Returns NULL on failure
+*/
+pacman_env_t *env_create(char *level_dir, char *level_file, int n_envs, int n_threads,
+                         int max_steps, uint64_t seed);
+
+void env_destroy(pacman_env_t *env);
+
+/*Cells of one observation (width * height of the level)*/
+int env_observation_size(const pacman_env_t *env);
+
+int env_width(const pacman_env_t *env);
+int env_height(const pacman_env_t *env);
+
+/*Restores every board to the template and writes the first observations*/
+void env_reset(pacman_env_t *env, char *observations);
+
+/*
+Advances every board by one tick: actions[i] ('W', 'A', 'S', 'D' or '\0'
+to stay) is played by pacman i, then its ghosts move. rewards[i] gets the
+points collected and statuses[i] an env_status_t. A finished board is
+reset immediately, so observations[i] is then the first frame of the next
+episode. Any output array may be NULL
+*/
+void env_step(pacman_env_t *env, const char *actions, char *observations, int *rewards, int *statuses);
+
+#endif
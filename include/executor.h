@@ -0,0 +1,30 @@
+#ifndef EXECUTOR_H
+#define EXECUTOR_H
+
+/*
+Work-stealing thread pool for the server's session work (ghost ticks and
+the frames that show them). Each worker owns a deque: it pushes and pops
+its own tasks at the bottom and, when it runs dry, steals from the top of
+another worker's deque, so a few heavy sessions do not leave cores idle.
+Tasks must not block waiting for other tasks.
+*/
+#define EXECUTOR_DEQUE_SIZE 1024  // Tasks per worker (power of two)
+
+typedef void (*task_fn_t)(void *arg);
+
+/*Starts n_workers threads (<= 0 for one per online core). Returns 0 on success*/
+int executor_start(int n_workers);
+
+int executor_workers(void);
+
+/*
+Queues fn(arg). From a worker the task goes to its own deque, from other
+threads the deques are filled in turn. Runs the task on the calling
+thread if every deque is full
+*/
+void executor_submit(task_fn_t fn, void *arg);
+
+/*Runs the tasks still queued and joins the workers*/
+void executor_stop(void);
+
+#endif
@@ -0,0 +1,51 @@
+#ifndef LOCKPROF_H
+#define LOCKPROF_H
+
+#include <pthread.h>
+
+/*
+Opt-in lock contention profiler (build with `make LOCK_PROFILING=1`).
+The server's session locks, board state locks and cell locks go through the
+prof_* macros below. When profiling is off they are the plain pthread calls.
+When it is on, every acquisition is counted per lock class, with log2
+histograms of the wait and hold times in nanoseconds, and the call sites
+that had to block are counted. lockprof_dump() writes the report.
+*/
+typedef enum {
+    LOCK_CLASS_SESSION = 0, // session_t.session_lock
+    LOCK_CLASS_STATE = 1,   // board_t.state_lock (read and write)
+    LOCK_CLASS_CELL = 2,    // board_t.cell_locks
+    LOCK_CLASS_COUNT
+} lock_class_t;
+
+#ifdef LOCK_PROFILING
+
+int lockprof_mutex_lock(lock_class_t cls, pthread_mutex_t *m, const char *file, int line);
+int lockprof_mutex_unlock(pthread_mutex_t *m);
+int lockprof_rwlock_rdlock(lock_class_t cls, pthread_rwlock_t *l, const char *file, int line);
+int lockprof_rwlock_wrlock(lock_class_t cls, pthread_rwlock_t *l, const char *file, int line);
+int lockprof_rwlock_unlock(pthread_rwlock_t *l);
+
+#define prof_mutex_lock(cls, m) lockprof_mutex_lock((cls), (m), __FILE__, __LINE__)
+#define prof_mutex_unlock(m) lockprof_mutex_unlock(m)
+#define prof_rwlock_rdlock(cls, l) lockprof_rwlock_rdlock((cls), (l), __FILE__, __LINE__)
+#define prof_rwlock_wrlock(cls, l) lockprof_rwlock_wrlock((cls), (l), __FILE__, __LINE__)
+#define prof_rwlock_unlock(l) lockprof_rwlock_unlock(l)
+
+#else
+
+#define prof_mutex_lock(cls, m) ((void)(cls), pthread_mutex_lock(m))
+#define prof_mutex_unlock(m) pthread_mutex_unlock(m)
+#define prof_rwlock_rdlock(cls, l) ((void)(cls), pthread_rwlock_rdlock(l))
+#define prof_rwlock_wrlock(cls, l) ((void)(cls), pthread_rwlock_wrlock(l))
+#define prof_rwlock_unlock(l) pthread_rwlock_unlock(l)
+
+#endif
+
+/*
+Writes the statistics gathered so far to path (a note when profiling was
+not compiled in). Returns 0 on success
+*/
+int lockprof_dump(const char *path);
+
+#endif
@@ -5,8 +5,15 @@
 #define MAX_COMMAND_LENGTH 256
 
 int read_line(int fd, char* buffer);
-int read_level(board_t* board, char* filename, char* dirname);
-int read_pacman(board_t* board, int points);
-int read_ghosts(board_t* board);
+int read_level(level_t* level, char* filename, char* dirname);
+int read_pacman(level_t* level);
+int read_ghosts(level_t* level);
+
+/*
+Gives the board's pacman the moves of its level's pacman file. Boards start
+without them: the server gets the moves from the client. Used by the
+standalone game and the tools that play the .p scripts
+*/
+int read_pacman_moves(board_t* board);
 
 #endif
@@ -0,0 +1,42 @@
+#ifndef PREDICTION_H
+#define PREDICTION_H
+
+#include "api.h"
+#include "board.h"
+#include "protocol.h"
+
+#define MAX_PENDING_INPUTS 64
+
+/*
+Client-side prediction: inputs are applied immediately with move_pacman on a
+local board rebuilt from the last authoritative frame. Each input carries a
+sequence number; when a frame acknowledges it, the local board is rebuilt
+from that frame and the still unacknowledged inputs are replayed on top.
+*/
+typedef struct {
+    pacman_session_t *session;          // Connection the inputs are sent on
+    board_t board;                      // Local board (walls, dots, ghosts from the server)
+    int cells_capacity;                 // Cells allocated (and mutexes initialized) in board
+    int ready;                          // A frame was received
+    int next_seq;
+    char pending[MAX_PENDING_INPUTS];   // Unacknowledged inputs, oldest first
+    int pending_seq[MAX_PENDING_INPUTS];
+    int n_pending;
+    Board frame;                        // Predicted frame handed to the renderer
+    char frame_data[MAX_BOARD_CELLS + 1];
+} prediction_t;
+
+void prediction_init(prediction_t *p, pacman_session_t *session);
+
+void prediction_destroy(prediction_t *p);
+
+/*Applies the input locally and sends it to the server tagged with its seq*/
+void prediction_input(prediction_t *p, char command);
+
+/*Rolls the local board back to an authoritative frame and replays unacknowledged inputs*/
+void prediction_reconcile(prediction_t *p, const Board *frame);
+
+/*Predicted frame to draw (NULL before the first authoritative frame)*/
+const Board* prediction_frame(prediction_t *p);
+
+#endif
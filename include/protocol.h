@@ -2,12 +2,34 @@
 #define PROTOCOL_H
 
 #define MAX_PIPE_PATH_LENGTH 256
+#define MAX_BOARD_CELLS 8000
+
+// OP_CODE_BOARD | width | height | tempo | victory | game_over | accumulated_points
+#define BOARD_HEADER_INTS 6
 
 enum {
   OP_CODE_CONNECT = 1,
   OP_CODE_DISCONNECT = 2,
   OP_CODE_PLAY = 3,
   OP_CODE_BOARD = 4,
+  OP_CODE_PLAY_SEQ = 5,   // OP_CODE | command | seq: play tagged for client-side prediction
+  OP_CODE_BOARD_SEQ = 6,  // Board message whose header ends with the last applied seq and the dropped batch commands
+  OP_CODE_PLAY_BATCH = 7, // OP_CODE | n | seq | n commands, played one per pacman turn (seq acked after the last, -1 for none)
+  OP_CODE_RESIZE = 8,     // Admin, on the admin pipe: OP_CODE | max_games
 };
 
+// Every registry message has the size of a connect request so reads never split them
+#define REGISTRY_MSG_SIZE (1 + MAX_PIPE_PATH_LENGTH * 3)
+
+// Admin requests go to <registry pipe>ADMIN_PIPE_SUFFIX, which only the server's user may open
+#define ADMIN_PIPE_SUFFIX ".admin"
+#define ADMIN_PIPE_PATH_LENGTH (MAX_PIPE_PATH_LENGTH + (int)sizeof(ADMIN_PIPE_SUFFIX))
+#define ADMIN_MSG_SIZE (1 + (int)sizeof(int))
+
+#define PLAY_SEQ_MSG_SIZE (2 + (int)sizeof(int))
+#define MAX_BATCH_COMMANDS 1024
+#define PLAY_BATCH_HEADER_SIZE (1 + 2 * (int)sizeof(int))
+// Ints after the board header of OP_CODE_BOARD_SEQ: ack_seq | dropped_commands
+#define BOARD_SEQ_EXTRA_INTS 2
+
 #endif
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "server.h"
+
+#define RECORDER_BUFFER_SIZE 65536
+#define RECORDER_FLUSH_MS 200
+
+// Recording file path (empty string disables recording)
+extern char record_file[256];
+
+// Starts the background writer; returns 0 on success
+int recorder_open(const char *path);
+
+// Flushes pending records and stops the writer
+void recorder_close(void);
+
+int recorder_enabled(void);
+
+/*
+Record hooks. Callers must be the ones ordering the session's events (its
+actor for plays and levels, session_lock for the start and end), so the
+file reflects the exact interleaving of pacman moves and ghost ticks.
+They never wait for the disk: a record that finds the buffer full is
+dropped, and the session's next record is preceded by a REC_GAP.
+*/
+void record_session_start(session_t *sess);
+void record_level(session_t *sess, const char *level_file, int points);
+void record_play(session_t *sess, char command);
+void record_end(session_t *sess);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define RECORDING_MAGIC "PREC"
+#define RECORDING_VERSION 2
+#define MAX_VARINT_BYTES 10
+
+/*
+Recording file: MAGIC | version | records...
+Every record starts with its type byte followed by the session key (varint).
+All integers are unsigned LEB128 varints; ticks are deltas from the previous
+record of the same session, so a move costs ~4 bytes.
+*/
+typedef enum {
+    REC_SESSION = 1, // key | client_id | seed
+    REC_LEVEL = 2,   // key | tick_delta | name_len | name | points
+    REC_PLAY = 3,    // key | tick_delta | command
+    REC_END = 4,     // key | tick_delta
+    REC_GAP = 5,     // key | tick_delta | lost: records of the session dropped before this point (version 2)
+} record_type_t;
+
+// Encodes value into out (at least MAX_VARINT_BYTES), returns bytes written
+int varint_encode(uint64_t value, unsigned char *out);
+
+// Decodes a varint from in, returns bytes consumed or -1 if truncated/invalid
+int varint_decode(const unsigned char *in, size_t len, uint64_t *value);
+
+#endif
@@ -4,34 +4,139 @@
 #include <pthread.h>
 #include <semaphore.h>
 #include <signal.h>
+#include <stdint.h>
+#include <stddef.h>
 #include "board.h" 
 #include "protocol.h"
 
 #define BUFFER_SIZE 10
+#define MAX_MANAGERS 4              // Managers only claim a slot and load the first level, sessions run as coroutines
+#define CONNECT_TIMEOUT_MS 5000     // Longest a session waits for its client to open the notification pipe
+#define CONNECT_RETRY_MS 5
+#define CMD_QUEUE_SIZE 4096
+#define PARK_MAX_TICKS 1024         // Longest a quiet session sleeps before its ghosts are looked at again
 
+#define CACHE_LINE_SIZE 64
+
+// Largest board message header: the opcode, BOARD_HEADER_INTS and the extra ints of OP_CODE_BOARD_SEQ
+#define FRAME_HEADER_MAX (1 + (BOARD_HEADER_INTS + BOARD_SEQ_EXTRA_INTS) * (int)sizeof(int))
+
+// Set once when a client connects, kept out of the session table
 typedef struct {
-    int active;                     
-    int session_id;              
-    
-    // Named Pipe Paths
     char req_pipe_path[MAX_PIPE_PATH_LENGTH];   // Client -> Server
     char notif_pipe_path[MAX_PIPE_PATH_LENGTH]; // Server -> Client
-    
+} session_cold_t;
+
+// Requests handed by the session's reader to its actor
+#define MAILBOX_SIZE 256            // Power of two
+
+typedef struct {
+    char op;                        // OP_CODE_PLAY, OP_CODE_PLAY_SEQ, OP_CODE_PLAY_BATCH (one queued command), OP_CODE_DISCONNECT or MAIL_FLUSH
+    char command;
+    int seq;                        // OP_CODE_PLAY_SEQ, and the last command of a tagged OP_CODE_PLAY_BATCH
+} mail_t;
+
+// Not a request: posted by the reader once notif_fd has room for the actor's pending frame
+#define MAIL_FLUSH 0
+
+// Lock-free single producer (reader), single consumer (actor) ring
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) _Atomic unsigned head;   // Next mail to take, written by the actor
+    _Alignas(CACHE_LINE_SIZE) _Atomic unsigned tail;   // Next free slot, written by the reader
+    _Alignas(CACHE_LINE_SIZE) mail_t slots[MAILBOX_SIZE];
+} mailbox_t;
+
+// Lateness of the ghost ticks, written by the actor and read by the stats dump
+typedef struct {
+    _Atomic uint64_t ticks;
+    _Atomic uint64_t late_total_ns; // Sum of (start of the tick - its deadline)
+    _Atomic uint64_t late_max_ns;
+    _Atomic uint64_t late_last_ns;  // Of the latest tick: back near 0 once a stall is caught up
+    _Atomic uint64_t skipped;       // Ticks dropped because the session fell too far behind
+} tick_stats_t;
+
+/*
+Sessions are cache line aligned so neighbouring slots never share a line.
+The first line holds what other threads read while scanning the table (slot
+search, top 5); the rest is used by the session's reader and actor and
+starts on the next line, so their writes do not invalidate the lines the
+scanners read.
+
+The board and everything the game changes belong to the session's actor
+(see actor.h): one activation at a time runs on the executor, so neither
+the board nor these fields need a lock.
+*/
+typedef struct {
+    // Hot: shared with the threads scanning the table
+    pthread_mutex_t session_lock;   // Guards the slot (active, session_id) between managers and scanners
+    int active;                     
+    int session_id;              
+    _Atomic int game_active;        // Cleared by the actor when the game ends
+    _Atomic int victory;              
+    _Atomic int points;             // Published by the actor after each activation
+    int parked;                     // checkpoint_start: 1 parked, 0 no game, -1 omitted stuck (checkpoint thread only)
+
     // File Descriptors
-    int req_fd;
-    int notif_fd;
+    _Alignas(CACHE_LINE_SIZE) int req_fd;   // Reader
+    int notif_fd;                           // Actor (and the reader before the actor starts)
+    struct coro *reader;                    // Reader coroutine, woken by the actor when the game ends
+    board_t *board;                 // Board of the current level (lives in arena, NULL between games)
     
     // Game State
-    board_t *board;                 
-    int game_active;             
-    int victory;              
     int current_level;        
+    int tick;                       // Ghost ticks played since the session started
+    int last_seq;                   // Last tagged play or batch applied (-1 if the client never tagged one)
+    uint64_t seed;                  // Per-session RNG seed (recorded for replays)
+    
+    // Commands queued by OP_CODE_PLAY_BATCH (ring buffer, one played per tick, actor only)
+    int queue_head;
+    int queue_len;
+    int batch_seq;                  // Seq of the latest tagged batch, acked once batch_left commands are played
+    int batch_left;
+    int dropped_commands;           // Batched commands the full queue turned away (reported in BOARD_SEQ frames)
+    char cmd_queue[CMD_QUEUE_SIZE];
+    
+    // Recording
+    unsigned long record_key;       // Unique key of this session in the recording file
+    int recorded_tick;              // Tick of the last record written for this session
+    int record_lost;                // Records dropped since then (the recorder's buffer was full)
     
-    // Threading
-    pthread_t update_thread;        // Thread responsible for ghost movement/updates
-    pthread_mutex_t session_lock;   // Mutex protecting access to this specific session's data
+    // Actor scheduling (see actor.h and ticker.h)
+    _Atomic int actor_state;        // ACTOR_OFF, ACTOR_IDLE, ACTOR_RUNNING or ACTOR_PARKED
+    _Atomic uint64_t tick_deadline; // CLOCK_MONOTONIC ns of the next ghost tick
+    int tick_slot;                  // Position in the ticker's heap + 1, 0 when not queued (under its mutex)
+    int tick_interval_ms;           // Tempo of the board being ticked
+    int tick_cells;                 // Its size, to group small boards in one task
+    tick_stats_t tick_stats;        // Since the game started
+
+    // Parking (actor only): the ghosts have nothing to do for idle_ticks ticks from idle_base,
+    // so the deadline was moved to the first tick that changes the board
+    int idle_ticks;
+    uint64_t idle_base;
+    uint64_t last_frame_hash;       // Of the last frame sent, repeated frames are not sent
+    int last_frame_len;
+
+    // Outgoing messages (actor only, the reader before the actor starts). notif_fd is
+    // non-blocking: what the client has no room for waits in out_buf, and a frame
+    // nobody has started to write is replaced by the next one
+    char *out_buf;                  // FRAME_HEADER_MAX + the largest level + a disconnect ack
+    int out_len;                    // Bytes pending (0 when everything was written)
+    int out_sent;                   // Of which already written
+    int out_stale;                  // A newer frame waits for a half written one to finish
+    _Atomic int out_blocked;        // The pipe was full: the reader posts MAIL_FLUSH once it has room
+
+    // Not cold: the arena embeds the live board_t (rng_state, state_lock), written every tick
+    board_arena_t arena;            // Sized for the largest level, reused across levels and games
+    mailbox_t mailbox;
+    _Atomic int mail_waiting;       // The mailbox was full: the actor wakes the reader once it drained it
+
+    // Cold
+    session_cold_t *cold;           // Named pipe paths
 } session_t;
 
+// The scanners' line must end where the reader's fields start
+_Static_assert(offsetof(session_t, req_fd) == CACHE_LINE_SIZE, "session_t hot part must fill exactly one cache line");
+
 
 typedef struct {
     char req_pipe_path[MAX_PIPE_PATH_LENGTH];
@@ -47,18 +152,45 @@ typedef struct {
     sem_t *empty;                   // Semaphore counting available slots (initial value = BUFFER_SIZE)
     sem_t *full;                    // Semaphore counting items to consume (initial value = 0)
     pthread_mutex_t mutex;          // Mutex for exclusive access to the buffer indices
+    int count;                      // Requests in the buffer
+    
+    // Consumers (manager threads) alive and how many of them were asked to exit.
+    // A retiring consumer is woken through full like a request would
+    int consumers;
+    int retiring;
     
     int active;        
 } connection_buffer_t;
 
+/*
+The session table grows in segments that never move, so sessions can be
+added at runtime (OP_CODE_RESIZE) while other threads hold pointers to
+existing ones. Segments are never freed before shutdown: shrinking only
+lowers max_games, sessions above it finish their games and are not reused.
+*/
+#define SESSION_SEGMENT_SIZE 16
+#define MAX_SESSION_SEGMENTS 4096
+#define MAX_SESSIONS_LIMIT (SESSION_SEGMENT_SIZE * MAX_SESSION_SEGMENTS)
+// Admin resizes may grow max_games up to this many times its value at startup
+#define RESIZE_GROWTH_MAX 4
+
+typedef struct {
+    session_t sessions[SESSION_SEGMENT_SIZE];
+    session_cold_t cold[SESSION_SEGMENT_SIZE];
+} session_segment_t;
+
 // Flags accessed by signal handlers and main loop
 extern _Atomic int server_running;
 extern _Atomic int sigusr1_received;
+extern _Atomic int sigusr2_received;
 
 // Configuration and Resources
 extern char registry_pipe[MAX_PIPE_PATH_LENGTH];
-extern session_t *sessions;
-extern int max_games;
+extern char admin_pipe[ADMIN_PIPE_PATH_LENGTH];   // 0600, admin requests (OP_CODE_RESIZE)
+extern int resize_limit;                          // Largest max_games an admin resize may ask for
+extern session_segment_t *session_segments[MAX_SESSION_SEGMENTS];
+extern _Atomic int allocated_sessions;  // Sessions with storage (only grows)
+extern _Atomic int max_games;           // Sessions that may be given to new clients (<= allocated_sessions)
 extern connection_buffer_t conn_buffer;
 extern char levels_dir[256];
 extern int shutdown_pipe[2];
@@ -68,19 +200,37 @@ void init_connection_buffer(connection_buffer_t *buffer);
 void destroy_connection_buffer(connection_buffer_t *buffer);
 void cleanup_connection_resources(connection_buffer_t *buffer);
 void buffer_insert(connection_buffer_t *buffer, connection_request_t *request);
+// Returns 0 with a request, 1 when the consumer must exit, -1 when there is nothing to do
 int buffer_remove(connection_buffer_t *buffer, connection_request_t *request);
+// Adjusts the consumers to wanted, returns how many new ones the caller must start
+int buffer_set_consumers(connection_buffer_t *buffer, int wanted);
+
+// --- Session Table ---
+static inline session_t* session_at(int index) {
+    return &session_segments[index / SESSION_SEGMENT_SIZE]->sessions[index % SESSION_SEGMENT_SIZE];
+}
+
+/*
+Sets the number of sessions to capacity: missing segments are allocated and
+the manager threads (up to MAX_MANAGERS) are started or asked to exit to
+match. Returns 0 on success
+*/
+int resize_sessions(int capacity);
 
 // --- Server Logic & Helpers ---
 void signal_handler(int signum);
 void send_board_update(session_t *sess);
+void session_actor_step(session_t *sess);          // Mail, due tick and frame (actor only)
+
+/*Plays the quiet ticks a parked session slept through (its actor or whoever parked it)*/
+void session_idle_catch_up(session_t *sess);
 int load_next_level(session_t *sess);
 void generate_top5_file();                       // Generates the scoreboard file
 void free_session_resources(session_t *sess);    
-int handle_move_result(session_t *sess, int result); // Processes the outcome of a move
+int handle_move_result(session_t *sess, int result); // Processes the outcome of a move (actor only)
 
 // --- Thread Entry Points ---
-void* update_sender(void* arg);  
-void* session_handler(void* arg); 
+void session_handler(void* arg);  // Coroutine (see coro.h)
 void* host_thread(void* arg);     // Producer
 void* manager_thread(void* arg);  // Consumer
 
@@ -0,0 +1,83 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "board.h"
+
+/*
+Deterministic play of a level's scripts, shared by the standalone game
+(--sim, --headless) and the level analyzer so they agree on every tick.
+*/
+
+// What a tick asks the caller to do
+#define CONTINUE_PLAY 0
+#define NEXT_LEVEL 1
+#define QUIT_GAME 2
+#define LOAD_BACKUP 3
+#define CREATE_BACKUP 4
+
+// ==========================================
+// Savepoints ('G'): an in-memory ring of compact board states.
+// Saving copies the cells and entity arrays into preallocated buffers and a
+// death rewinds to the most recent save, which is consumed.
+
+#define MAX_SAVES 8
+
+typedef struct {
+    char content;
+    char has_dot;
+    char has_portal;
+} saved_cell_t;
+
+typedef struct {
+    saved_cell_t *cells;
+    pacman_t *pacmans;
+    ghost_t *ghosts;
+    uint64_t rng_state;
+} save_t;
+
+typedef struct {
+    save_t slots[MAX_SAVES];
+    int cells_capacity, pacmans_capacity, ghosts_capacity;
+    int head;   // Next slot to write
+    int count;  // Saves available (the oldest are overwritten when full)
+} save_ring_t;
+
+/*Empties the ring and makes sure its buffers fit the board (reused across levels). Returns 0 on success*/
+int save_ring_reset(save_ring_t *ring, board_t *board);
+void save_ring_free(save_ring_t *ring);
+
+/*Only called while no entity thread is running*/
+void save_push(save_ring_t *ring, board_t *board);
+
+/*Rewinds the board to the latest save. Returns -1 if there is none*/
+int save_pop(save_ring_t *ring, board_t *board);
+
+/*
+One tick: pacman plays its script or key ('\0' for none), then the ghosts
+move. A 'G' only asks for a save (CREATE_BACKUP), the board does not move.
+Returns one of the codes above
+*/
+int simulation_tick(board_t *board, char key);
+
+/*
+simulation_tick with the savepoints handled: saves on 'G' and rewinds on a
+death when it can. Returns CONTINUE_PLAY, NEXT_LEVEL, QUIT_GAME or
+LOAD_BACKUP (died without a save to go back to)
+*/
+int simulation_step(board_t *board, save_ring_t *saves);
+
+// ==========================================
+// Batch helpers
+
+/*
+The .lvl files of dirname, sorted so the output of the tools does not
+depend on readdir order. Returns how many, or -1 if the directory cannot
+be opened. free_level_files releases them
+*/
+int list_level_files(const char *dirname, char ***levels);
+void free_level_files(char **levels, int n_levels);
+
+/*Runs job(ctx, i) for every i < n_jobs on up to n_workers threads, returns when all are done*/
+void run_jobs(int n_jobs, int n_workers, void (*job)(void *ctx, int index), void *ctx);
+
+#endif
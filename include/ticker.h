@@ -0,0 +1,65 @@
+#ifndef TICKER_H
+#define TICKER_H
+
+#include "server.h"
+
+/*
+One ticker thread drives the ghost ticks of every session. Idle actors
+are queued in a min-heap on their deadline (every transition to
+ACTOR_IDLE is followed by ticker_schedule), so a wake up only looks at the
+sessions that are due. It claims them (see actor.h) and hands them to the
+executor: small boards are grouped into one task so a pass over many of
+them stays on one core, large boards get a task of their own and can be
+stolen by idle workers.
+*/
+#define TICK_BATCH_MAX 16       // Sessions per tick task
+#define TICK_BATCH_CELLS 4096   // A board larger than this is ticked alone
+#define TICKER_IDLE_MS 100      // Longest sleep when no session is queued
+#define TICK_DUE_CHUNK 64       // Due sessions taken off the heap per lock hold
+#define TICK_CATCHUP_DEFAULT 4  // Late ticks caught up before the schedule skips ahead
+
+/*
+Ticks follow an absolute schedule (deadline += tempo), so the time a tick
+takes does not slow the game down. A session that falls behind replays the
+missed ticks back to back, up to tick_catchup_max of them; further behind,
+the missed ticks are skipped and counted. 0 always skips
+*/
+extern int tick_catchup_max;    // --tick-catchup
+
+int ticker_start(void);
+
+/*Stops the ticker; tasks already submitted still run on the executor*/
+void ticker_stop(void);
+
+/*
+Restarts the session's tick clock from its current board: every tempo ms,
+the first tick one tempo from now. Called by the board's owner
+*/
+void ticker_arm(session_t *sess);
+
+/*Sizes the heap for sessions (the table only grows). Returns 0 on success*/
+int ticker_reserve(int sessions);
+
+/*
+Queues the session at its current tick_deadline, or moves it there (a
+finished game's UINT64_MAX takes it out). Wakes the ticker when the tick is
+earlier than it planned to wake up
+*/
+void ticker_schedule(session_t *sess);
+
+/*Takes the session out of the heap (its actor stopped)*/
+void ticker_unschedule(session_t *sess);
+
+/*
+Actor: records how late the tick that started at now was and moves the
+deadline to the next tick of the schedule
+*/
+void ticker_advance(session_t *sess, uint64_t now);
+
+/*Clears the session's tick statistics (before its game starts)*/
+void ticker_reset_stats(session_t *sess);
+
+/*Appends the tick jitter of every playing session to path. Returns 0 on success*/
+int ticker_dump(const char *path);
+
+#endif
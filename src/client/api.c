@@ -9,6 +9,14 @@
 #include <sys/stat.h>
 #include <stdlib.h>
 #include <pthread.h>
+#include <errno.h>
+#include <poll.h>
+#include <stdatomic.h>
+
+// Largest notification: OP_CODE | header ints (with ack_seq and dropped_commands) | board cells
+#define RX_BUFFER_SIZE (1 + (BOARD_HEADER_INTS + BOARD_SEQ_EXTRA_INTS) * (int)sizeof(int) + MAX_BOARD_CELLS)
+// How long pacman_disconnect waits for the acknowledgement
+#define DISCONNECT_TIMEOUT_MS 1000
 
 struct Session {
   int id;
@@ -16,15 +24,41 @@ struct Session {
   int notif_pipe; // File descriptor for reading notifications
   char req_pipe_path[MAX_PIPE_PATH_LENGTH + 1];
   char notif_pipe_path[MAX_PIPE_PATH_LENGTH + 1];
-};
 
-// Session structure protected by a mutex
-static struct Session session = {.id = -1};
-static pthread_mutex_t session_mutex = PTHREAD_MUTEX_INITIALIZER;
+  // Double buffered frame storage: the receiver decodes into frames[!front]
+  // and publishes it by flipping front under frame_mutex
+  Board frames[2];
+  char frame_data[2][MAX_BOARD_CELLS + 1];
+  int front;
+  int has_frame;
+
+  pthread_mutex_t session_mutex; // Protects the pipe descriptors and rx_busy
+  pthread_mutex_t frame_mutex;   // Protects front/has_frame and borrowed frames
+  pthread_cond_t rx_idle;        // Signalled when the receiving thread lets go of rx_busy
+  int rx_busy;                   // A thread is decoding (see rx_begin)
+  pthread_t rx_owner;            // That thread, whose callbacks must not decode again
+  int disconnect_sent;
+
+  // The notification pipe is non-blocking: bytes are assembled here until a
+  // whole message arrived. Only the thread holding rx_busy touches these fields
+  char rx_buf[RX_BUFFER_SIZE];
+  int rx_len;
+  _Atomic int closed;     // Stream over (disconnect ack, EOF or bad message)
+  int disconnect_result;  // Result byte of the disconnect acknowledgement
+  int last_victory;
 
-int pacman_connect(char const *req_pipe_path, char const *notif_pipe_path, char const *server_pipe_path) {
-  strncpy(session.req_pipe_path, req_pipe_path, MAX_PIPE_PATH_LENGTH);
-  strncpy(session.notif_pipe_path, notif_pipe_path, MAX_PIPE_PATH_LENGTH);
+  pacman_callbacks_t callbacks;
+  void *user_data;
+};
+
+// Creates both FIFOs, registers with the server and opens them. Returns 1 on failure
+static int session_connect(struct Session *session, char const *req_pipe_path, char const *notif_pipe_path, char const *server_pipe_path) {
+  strncpy(session->req_pipe_path, req_pipe_path, MAX_PIPE_PATH_LENGTH);
+  strncpy(session->notif_pipe_path, notif_pipe_path, MAX_PIPE_PATH_LENGTH);
+  session->frames[0].data = session->frame_data[0];
+  session->frames[1].data = session->frame_data[1];
+  session->front = 0;
+  session->has_frame = 0;
   
   // Remove pipes that might exist from previous crashed sessions
   unlink(req_pipe_path);
@@ -50,7 +84,7 @@ int pacman_connect(char const *req_pipe_path, char const *notif_pipe_path, char
   }
   
   // OP_CODE_CONNECT | req_pipe_path | notif_pipe_path | server_pipe_path
-  char msg[MAX_PIPE_PATH_LENGTH * 3 + 1];
+  char msg[REGISTRY_MSG_SIZE];
   msg[0] = OP_CODE_CONNECT;
   memcpy(msg + 1, req_pipe_path, MAX_PIPE_PATH_LENGTH);
   memcpy(msg + 1 + MAX_PIPE_PATH_LENGTH, notif_pipe_path, MAX_PIPE_PATH_LENGTH);
@@ -67,17 +101,17 @@ int pacman_connect(char const *req_pipe_path, char const *notif_pipe_path, char
   close(server_fd);
   
   // Open FIFOs for communication
-  session.req_pipe = open(req_pipe_path, O_WRONLY);
-  if (session.req_pipe == -1) {
+  session->req_pipe = open(req_pipe_path, O_WRONLY);
+  if (session->req_pipe == -1) {
     unlink(req_pipe_path);
     unlink(notif_pipe_path);
     return 1;
   }
   
   // Open notification pipe for reading
-  session.notif_pipe = open(notif_pipe_path, O_RDONLY);
-  if (session.notif_pipe == -1) {
-    close(session.req_pipe);
+  session->notif_pipe = open(notif_pipe_path, O_RDONLY);
+  if (session->notif_pipe == -1) {
+    close(session->req_pipe);
     unlink(req_pipe_path);
     unlink(notif_pipe_path);
     return 1;
@@ -86,22 +120,227 @@ int pacman_connect(char const *req_pipe_path, char const *notif_pipe_path, char
   // Wait for confirmation message from the server
   // The client remains blocked here until the server assigns a slot
   char confirmation[2];
-  ssize_t bytes_read = read(session.notif_pipe, confirmation, 2);
+  ssize_t bytes_read = read(session->notif_pipe, confirmation, 2);
   if (bytes_read != 2 || confirmation[0] != OP_CODE_CONNECT) {
-    close(session.req_pipe);
-    close(session.notif_pipe);
+    close(session->req_pipe);
+    close(session->notif_pipe);
     unlink(req_pipe_path);
     unlink(notif_pipe_path);
     return 1;
   }
+
+  // From here on frames are assembled incrementally (see pacman_poll)
+  int flags = fcntl(session->notif_pipe, F_GETFL, 0);
+  fcntl(session->notif_pipe, F_SETFL, flags | O_NONBLOCK);
   
   return 0;
 }
 
-void pacman_play(char command) {
-  pthread_mutex_lock(&session_mutex);
-  int req_pipe = session.req_pipe;
-  pthread_mutex_unlock(&session_mutex);
+// Only one thread decodes at a time: waits until no other call is receiving.
+// Returns 0 without waiting when called from a callback of the decoding thread
+static int rx_begin(struct Session *session) {
+  pthread_mutex_lock(&session->session_mutex);
+  if (session->rx_busy && pthread_equal(session->rx_owner, pthread_self())) {
+    pthread_mutex_unlock(&session->session_mutex);
+    return 0;
+  }
+  while (session->rx_busy) {
+    pthread_cond_wait(&session->rx_idle, &session->session_mutex);
+  }
+  session->rx_busy = 1;
+  session->rx_owner = pthread_self();
+  pthread_mutex_unlock(&session->session_mutex);
+  return 1;
+}
+
+static void rx_end(struct Session *session) {
+  pthread_mutex_lock(&session->session_mutex);
+  session->rx_busy = 0;
+  pthread_cond_broadcast(&session->rx_idle);
+  pthread_mutex_unlock(&session->session_mutex);
+}
+
+static void mark_closed(struct Session *session) {
+  if (atomic_exchange(&session->closed, 1)) return;
+  if (session->callbacks.on_disconnect) {
+    session->callbacks.on_disconnect(session->user_data);
+  }
+}
+
+// Reads whatever is available into rx_buf, waiting up to timeout_ms (-1 forever).
+// Returns the bytes read, 0 if nothing arrived, -1 once the stream is over
+static int rx_fill(struct Session *session, int timeout_ms) {
+  pthread_mutex_lock(&session->session_mutex);
+  int notif_pipe = session->notif_pipe;
+  pthread_mutex_unlock(&session->session_mutex);
+
+  if (notif_pipe == -1 || session->closed) {
+    mark_closed(session);
+    return -1;
+  }
+
+  struct pollfd pfd = { .fd = notif_pipe, .events = POLLIN };
+  int ready = poll(&pfd, 1, timeout_ms);
+  if (ready == 0 || (ready == -1 && errno == EINTR)) {
+    return 0;
+  }
+  if (ready == -1 || (pfd.revents & POLLNVAL)) {
+    mark_closed(session);
+    return -1;
+  }
+
+  ssize_t n = read(notif_pipe, session->rx_buf + session->rx_len, RX_BUFFER_SIZE - session->rx_len);
+  if (n > 0) {
+    session->rx_len += n;
+    return n;
+  }
+  if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+    return 0;
+  }
+  mark_closed(session);
+  return -1;
+}
+
+static void rx_consume(struct Session *session, int len) {
+  memmove(session->rx_buf, session->rx_buf + len, session->rx_len - len);
+  session->rx_len -= len;
+}
+
+// Decodes one message from rx_buf. Returns 1 when a frame was published,
+// 0 when more bytes are needed, -1 once the stream is over
+static int rx_decode(struct Session *session) {
+  if (session->closed) return -1;
+  if (session->rx_len < 1) return 0;
+
+  char op_code = session->rx_buf[0];
+  if (op_code != OP_CODE_BOARD && op_code != OP_CODE_BOARD_SEQ) {
+    // Disconnect acknowledgement (or garbage): the stream is over
+    if (op_code == OP_CODE_DISCONNECT) {
+      if (session->rx_len < 2) return 0;
+      session->disconnect_result = session->rx_buf[1];
+    }
+    session->rx_len = 0;
+    mark_closed(session);
+    return -1;
+  }
+
+  // OP_CODE | width | height | time | victory | game_over | accumulated_points | [ack_seq | dropped] | board_data
+  int header[BOARD_HEADER_INTS + BOARD_SEQ_EXTRA_INTS];
+  int header_ints = (op_code == OP_CODE_BOARD_SEQ) ? BOARD_HEADER_INTS + BOARD_SEQ_EXTRA_INTS : BOARD_HEADER_INTS;
+  int header_len = 1 + header_ints * (int)sizeof(int);
+  if (session->rx_len < header_len) return 0;
+  memcpy(header, session->rx_buf + 1, header_ints * sizeof(int));
+
+  int board_size = header[0] * header[1];
+  if (header[0] <= 0 || header[1] <= 0 || board_size > MAX_BOARD_CELLS) {
+    mark_closed(session);
+    return -1;
+  }
+  if (session->rx_len < header_len + board_size) return 0;
+
+  // Only the receiver touches the back buffer: borrowers can only see the front
+  Board *back = &session->frames[!session->front];
+  back->width = header[0];
+  back->height = header[1];
+  back->tempo = header[2];
+  back->victory = header[3];
+  back->game_over = header[4];
+  back->accumulated_points = header[5];
+  back->ack_seq = (op_code == OP_CODE_BOARD_SEQ) ? header[BOARD_HEADER_INTS] : -1;
+  back->dropped_commands = (op_code == OP_CODE_BOARD_SEQ) ? header[BOARD_HEADER_INTS + 1] : 0;
+  memcpy(back->data, session->rx_buf + header_len, board_size);
+  back->data[board_size] = '\0';
+  rx_consume(session, header_len + board_size);
+
+  pthread_mutex_lock(&session->frame_mutex);
+  session->front = !session->front;
+  session->has_frame = 1;
+  pthread_mutex_unlock(&session->frame_mutex);
+
+  // Callbacks run on the receiving thread, the only one that flips front,
+  // so the frame stays valid for the duration of the call
+  pacman_callbacks_t *cb = &session->callbacks;
+  if (cb->on_board) cb->on_board(back, session->user_data);
+  if (back->victory && !session->last_victory && cb->on_victory) cb->on_victory(back, session->user_data);
+  if (back->game_over && cb->on_game_over) cb->on_game_over(back, session->user_data);
+  session->last_victory = back->victory;
+  return 1;
+}
+
+pacman_session_t *pacman_open(char const *req_pipe_path, char const *notif_pipe_path, char const *server_pipe_path) {
+  struct Session *session = calloc(1, sizeof(struct Session));
+  if (!session) {
+    return NULL;
+  }
+  session->id = -1;
+  session->req_pipe = -1;
+  session->notif_pipe = -1;
+  pthread_mutex_init(&session->session_mutex, NULL);
+  pthread_mutex_init(&session->frame_mutex, NULL);
+  pthread_cond_init(&session->rx_idle, NULL);
+
+  if (session_connect(session, req_pipe_path, notif_pipe_path, server_pipe_path) != 0) {
+    session->req_pipe = -1;
+    session->notif_pipe = -1;
+    pacman_close(session);
+    return NULL;
+  }
+  return session;
+}
+
+int pacman_admin_resize(char const *server_pipe_path, int max_games) {
+  char admin_path[ADMIN_PIPE_PATH_LENGTH];
+  snprintf(admin_path, sizeof(admin_path), "%s%s", server_pipe_path, ADMIN_PIPE_SUFFIX);
+  int admin_fd = open(admin_path, O_WRONLY);
+  if (admin_fd == -1) {
+    return 1;
+  }
+
+  // OP_CODE_RESIZE | max_games
+  char msg[ADMIN_MSG_SIZE];
+  msg[0] = OP_CODE_RESIZE;
+  memcpy(msg + 1, &max_games, sizeof(int));
+
+  int result = write(admin_fd, msg, sizeof(msg)) == (ssize_t)sizeof(msg) ? 0 : 1;
+  close(admin_fd);
+  return result;
+}
+
+void pacman_close(pacman_session_t *session) {
+  if (!session) {
+    return;
+  }
+  pthread_mutex_lock(&session->session_mutex);
+  int connected = session->req_pipe != -1;
+  pthread_mutex_unlock(&session->session_mutex);
+
+  if (connected) {
+    pacman_disconnect(session);
+  }
+  pthread_mutex_destroy(&session->session_mutex);
+  pthread_mutex_destroy(&session->frame_mutex);
+  pthread_cond_destroy(&session->rx_idle);
+  free(session);
+}
+
+int pacman_request_fd(pacman_session_t *session) {
+  pthread_mutex_lock(&session->session_mutex);
+  int fd = session->req_pipe;
+  pthread_mutex_unlock(&session->session_mutex);
+  return fd;
+}
+
+int pacman_notification_fd(pacman_session_t *session) {
+  pthread_mutex_lock(&session->session_mutex);
+  int fd = session->notif_pipe;
+  pthread_mutex_unlock(&session->session_mutex);
+  return fd;
+}
+
+void pacman_play(pacman_session_t *session, char command) {
+  pthread_mutex_lock(&session->session_mutex);
+  int req_pipe = session->req_pipe;
+  pthread_mutex_unlock(&session->session_mutex);
   
   if (req_pipe == -1) {
     return;
@@ -117,104 +356,199 @@ void pacman_play(char command) {
   }
 }
 
-int pacman_disconnect() {
-  pthread_mutex_lock(&session_mutex);
-  int req_pipe = session.req_pipe;
-  int notif_pipe = session.notif_pipe;
+int pacman_play_batch(pacman_session_t *session, const char *cmds, int n) {
+  return pacman_play_batch_seq(session, cmds, n, -1);
+}
+
+int pacman_play_batch_seq(pacman_session_t *session, const char *cmds, int n, int seq) {
+  pthread_mutex_lock(&session->session_mutex);
+  int req_pipe = session->req_pipe;
+  pthread_mutex_unlock(&session->session_mutex);
+
+  if (req_pipe == -1 || n < 0) {
+    return 1;
+  }
+
+  // OP_CODE_PLAY_BATCH | n | seq | commands, only the last message is tagged
+  char msg[PLAY_BATCH_HEADER_SIZE + MAX_BATCH_COMMANDS];
+  for (int sent = 0; sent < n; ) {
+    int chunk = n - sent;
+    if (chunk > MAX_BATCH_COMMANDS) chunk = MAX_BATCH_COMMANDS;
+    int chunk_seq = (sent + chunk == n) ? seq : -1;
+
+    msg[0] = OP_CODE_PLAY_BATCH;
+    memcpy(msg + 1, &chunk, sizeof(int));
+    memcpy(msg + 1 + sizeof(int), &chunk_seq, sizeof(int));
+    memcpy(msg + PLAY_BATCH_HEADER_SIZE, cmds + sent, chunk);
+
+    if (write(req_pipe, msg, PLAY_BATCH_HEADER_SIZE + chunk) == -1) {
+      perror("Failed to send play batch");
+      return 1;
+    }
+    sent += chunk;
+  }
+  return 0;
+}
+
+void pacman_play_seq(pacman_session_t *session, char command, int seq) {
+  pthread_mutex_lock(&session->session_mutex);
+  int req_pipe = session->req_pipe;
+  pthread_mutex_unlock(&session->session_mutex);
+
+  if (req_pipe == -1) {
+    return;
+  }
+
+  // OP_CODE_PLAY_SEQ | command_char | seq
+  char msg[PLAY_SEQ_MSG_SIZE];
+  msg[0] = OP_CODE_PLAY_SEQ;
+  msg[1] = command;
+  memcpy(msg + 2, &seq, sizeof(int));
+
+  if (write(req_pipe, msg, sizeof(msg)) == -1) {
+      perror("Failed to send play command");
+  }
+}
+
+int pacman_disconnect(pacman_session_t *session) {
+  pthread_mutex_lock(&session->session_mutex);
+  int req_pipe = session->req_pipe;
   char req_path[MAX_PIPE_PATH_LENGTH + 1];
   char notif_path[MAX_PIPE_PATH_LENGTH + 1];
   
   // Copy paths to local stack to safely use them after unlocking
-  strncpy(req_path, session.req_pipe_path, MAX_PIPE_PATH_LENGTH + 1);
-  strncpy(notif_path, session.notif_pipe_path, MAX_PIPE_PATH_LENGTH + 1);
+  strncpy(req_path, session->req_pipe_path, MAX_PIPE_PATH_LENGTH + 1);
+  strncpy(notif_path, session->notif_pipe_path, MAX_PIPE_PATH_LENGTH + 1);
   
   if (req_pipe == -1) {
-    pthread_mutex_unlock(&session_mutex);
+    pthread_mutex_unlock(&session->session_mutex);
     return 1;
   }
-  pthread_mutex_unlock(&session_mutex);
+  int send_request = !session->disconnect_sent;
+  session->disconnect_sent = 1;
+  pthread_mutex_unlock(&session->session_mutex);
   
   // Send disconnect request
   char msg[1];
   msg[0] = OP_CODE_DISCONNECT;
   
-  if (write(req_pipe, msg, 1) == -1) {
+  if (send_request && write(req_pipe, msg, 1) == -1) {
       perror("Failed to send disconnect");
   }
   
-  // Wait for server acknowledgement
-  char response[2] = {0};
-  
-  if (read(notif_pipe, response, 2) <= 0) {
-      // If read fails, continue anyway to clean up local resources
+  // From a callback: the poll in progress receives the acknowledgement
+  // and pacman_close closes the pipes afterwards
+  if (!rx_begin(session)) {
+    return 0;
+  }
+
+  // Wait for server acknowledgement; frames still in flight come first.
+  // A receive in progress on another thread ends with its next frame (or
+  // the acknowledgement), then the rest is decoded here. If it never
+  // arrives, continue anyway to clean up local resources
+  while (!session->closed) {
+    if (rx_decode(session) != 0) continue;
+    if (rx_fill(session, DISCONNECT_TIMEOUT_MS) <= 0) break;
   }
   
-  pthread_mutex_lock(&session_mutex);
+  pthread_mutex_lock(&session->session_mutex);
   // Close file descriptors
-  close(session.req_pipe);
-  close(session.notif_pipe);
+  close(session->req_pipe);
+  close(session->notif_pipe);
   
   // Remove FIFO files from filesystem
   unlink(req_path);
   unlink(notif_path);
   
-  session.req_pipe = -1;
-  session.notif_pipe = -1;
-  pthread_mutex_unlock(&session_mutex);
+  session->req_pipe = -1;
+  session->notif_pipe = -1;
+  pthread_mutex_unlock(&session->session_mutex);
+  // Receivers waiting for their turn now find the stream closed
+  mark_closed(session);
+  rx_end(session);
   
-  return response[1];
+  return session->disconnect_result;
 }
 
-Board receive_board_update(void) {
-  Board board = {0};
-  
-  pthread_mutex_lock(&session_mutex);
-  int notif_pipe = session.notif_pipe;
-  pthread_mutex_unlock(&session_mutex);
-  
-  if (notif_pipe == -1) {
-    return board;
+int pacman_receive_frame(pacman_session_t *session) {
+  if (!rx_begin(session)) return -1;
+  int result;
+  while (1) {
+    int decoded = rx_decode(session);
+    if (decoded != 0) {
+      result = decoded > 0 ? 0 : -1;
+      break;
+    }
+    if (rx_fill(session, -1) < 0) {
+      result = -1;
+      break;
+    }
   }
-  
-  // OP_CODE | width | height | time | victory | game_over | accumulated_points | board_data
-  char buffer[8192];
-  ssize_t bytes_read = read(notif_pipe, buffer, sizeof(buffer));
-  
-  if (bytes_read <= 0) {
-    return board;
+  rx_end(session);
+  return result;
+}
+
+int pacman_poll(pacman_session_t *session, int timeout_ms) {
+  if (!rx_begin(session)) return 0;
+  int frames = 0;
+  int waited = 0;
+  while (!session->closed) {
+    int decoded = rx_decode(session);
+    if (decoded > 0) {
+      frames++;
+      continue;
+    }
+    if (decoded < 0) break;
+
+    // Block at most once, then only drain what is already in the pipe
+    int n = rx_fill(session, (waited || frames > 0) ? 0 : timeout_ms);
+    waited = 1;
+    if (n <= 0) break;
   }
-  
-  int offset = 0;
-  
-  // Validate OpCode
-  char op_code = buffer[offset++];
-  if (op_code != OP_CODE_BOARD) {
+  int result = (frames == 0 && session->closed) ? -1 : frames;
+  rx_end(session);
+  return result;
+}
+
+void pacman_set_callbacks(pacman_session_t *session, const pacman_callbacks_t *callbacks, void *user_data) {
+  if (callbacks) {
+    session->callbacks = *callbacks;
+  } else {
+    memset(&session->callbacks, 0, sizeof(session->callbacks));
+  }
+  session->user_data = user_data;
+}
+
+const Board* pacman_borrow_board(pacman_session_t *session) {
+  pthread_mutex_lock(&session->frame_mutex);
+  if (!session->has_frame) {
+    pthread_mutex_unlock(&session->frame_mutex);
+    return NULL;
+  }
+  return &session->frames[session->front];
+}
+
+void pacman_release_board(pacman_session_t *session) {
+  pthread_mutex_unlock(&session->frame_mutex);
+}
+
+Board receive_board_update(pacman_session_t *session) {
+  Board board = {0};
+
+  if (pacman_receive_frame(session) != 0) {
     return board;
   }
-  
-  // Deserialize dimensions and game state
-  memcpy(&board.width, buffer + offset, sizeof(int));
-  offset += sizeof(int);
-  memcpy(&board.height, buffer + offset, sizeof(int));
-  offset += sizeof(int);
-  memcpy(&board.tempo, buffer + offset, sizeof(int));
-  offset += sizeof(int);
-  memcpy(&board.victory, buffer + offset, sizeof(int));
-  offset += sizeof(int);
-  memcpy(&board.game_over, buffer + offset, sizeof(int));
-  offset += sizeof(int);
-  memcpy(&board.accumulated_points, buffer + offset, sizeof(int));
-  offset += sizeof(int);
-  
-  int board_size = board.width * board.height;
-  
-  if (board_size > 0 && board_size < 8000) { 
-      board.data = malloc(board_size + 1);
-      if (board.data) { // Ensure malloc succeeded
-        memcpy(board.data, buffer + offset, board_size);
-        board.data[board_size] = '\0'; // Null-terminate for string safety
-      }
+
+  const Board *frame = pacman_borrow_board(session);
+  if (frame) {
+    board = *frame;
+    size_t board_size = frame->width * frame->height;
+    board.data = malloc(board_size + 1);
+    if (board.data) { // Ensure malloc succeeded
+      memcpy(board.data, frame->data, board_size + 1);
+    }
+    pacman_release_board(session);
   }
-  
+
   return board;
-}
\ No newline at end of file
+}
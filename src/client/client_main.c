@@ -2,97 +2,208 @@
 #include "protocol.h"
 #include "display.h"
 #include "debug.h"
+#include "prediction.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include <pthread.h>
 #include <stdbool.h>
 #include <unistd.h>
-#include <pthread.h>
+#include <poll.h>
+#include <time.h>
 
-Board board = {0};
+// Rendering is capped independently of the server tempo
+#define MAX_FPS 30
+#define FRAME_INTERVAL_MS (1000 / MAX_FPS)
+// Script batches sent but not yet acked: the next one waits in the server's queue
+#define SCRIPT_BATCHES_AHEAD 2
+
+// Everything runs on the main thread: frames arrive through pacman_poll callbacks
 bool stop_execution = false;
-int tempo = 0;
-pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-
-static void *receiver_thread(void *arg) {
-    (void)arg;
-
-    while (true) {
-        
-        Board new_board = receive_board_update();
-
-        if (!new_board.data || new_board.game_over == 1){
-            pthread_mutex_lock(&mutex);
-            stop_execution = true;
-            
-            // Update the global board one last time
-            if (board.data) {
-                free(board.data);
-            }
-            board = new_board;
-            pthread_mutex_unlock(&mutex);
+unsigned long frames_received = 0; // Published frames, the renderer draws when it changes
+
+// Script mode: batches are tagged 0, 1, 2... and acked in the frames
+static int next_batch = 0;
+static int acked_batch = -1;
+static int script_pos = 0;
+static bool script_sent = false;   // A quitting script was sent once, only its ack is missing
+static int dropped_commands = 0;
+
+// Client-side prediction (--predict), only touched by the main thread
+static bool predict = false;
+static bool prediction_dirty = false;
+static prediction_t prediction;
+
+static long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static void on_board(const Board *board, void *user_data) {
+    (void)user_data;
+    if (board->ack_seq > acked_batch) acked_batch = board->ack_seq;
+    if (board->dropped_commands > dropped_commands) {
+        debug("Server queue full: %d script commands dropped\n", board->dropped_commands - dropped_commands);
+        dropped_commands = board->dropped_commands;
+    }
+    frames_received++;
+}
 
-            clear();
-            refresh();
+static void on_game_over(const Board *board, void *user_data) {
+    (void)board;
+    (void)user_data;
+    stop_execution = true;
+}
 
-            break;
+static void on_disconnect(void *user_data) {
+    (void)user_data;
+    debug("Server closed the session\n");
+    stop_execution = true;
+}
+
+// Draws the latest frame if a new one arrived and the frame cap allows it
+static void render_latest_frame(pacman_session_t *session) {
+    static unsigned long drawn_frame = 0;
+    static long last_draw_ms = 0;
+
+    unsigned long latest = frames_received;
+
+    long now = now_ms();
+    if ((latest == drawn_frame && !prediction_dirty) || now - last_draw_ms < FRAME_INTERVAL_MS) return;
+
+    const Board *frame = pacman_borrow_board(session);
+    if (!frame) return;
+
+    if (predict) {
+        // Authoritative frame + inputs it has not acknowledged yet
+        prediction_reconcile(&prediction, frame);
+        pacman_release_board(session);
+        frame = prediction_frame(&prediction);
+        prediction_dirty = false;
+    }
+
+    if (frame) {
+        draw_board_client(*frame);
+        refresh_screen();
+    }
+    if (!predict) pacman_release_board(session);
+
+    drawn_frame = latest;
+    last_draw_ms = now;
+}
+
+// Waits for the given time while receiving frames and keeping the screen up to date
+static void wait_and_render(pacman_session_t *session, int milliseconds) {
+    long deadline = now_ms() + milliseconds;
+    long remaining;
+    while ((remaining = deadline - now_ms()) > 0 && !stop_execution) {
+        pacman_poll(session, remaining < FRAME_INTERVAL_MS ? remaining : FRAME_INTERVAL_MS);
+        render_latest_frame(session);
+    }
+}
+
+// Sends script batches until SCRIPT_BATCHES_AHEAD are waiting for their ack, so
+// the server never runs out and nothing piles up when it falls behind.
+// Returns false if the request pipe failed
+static bool feed_script(pacman_session_t *session, const char *script, int len, bool quits) {
+    while (len > 0 && !script_sent && next_batch - 1 - acked_batch < SCRIPT_BATCHES_AHEAD) {
+        int n = len - script_pos;
+        if (n > MAX_BATCH_COMMANDS) n = MAX_BATCH_COMMANDS;
+        if (pacman_play_batch_seq(session, script + script_pos, n, next_batch) != 0) return false;
+        next_batch++;
+        script_pos += n;
+        if (script_pos == len) {
+            script_pos = 0;
+            script_sent = quits;
         }
+    }
+    return true;
+}
+
+// Reads the commands file into a script (uppercase, no line breaks).
+// A 'Q' ends the script; quits is set so the client leaves after playing it
+static char *load_script(FILE *fp, int *len, bool *quits) {
+    int capacity = 64;
+    char *script = malloc(capacity);
+    *len = 0;
+    *quits = false;
+    if (!script) return NULL;
 
-        pthread_mutex_lock(&mutex);
-        tempo = new_board.tempo;
-        
-        // Free old board data and update global board
-        if (board.data) {
-            free(board.data);
+    int ch;
+    while ((ch = fgetc(fp)) != EOF) {
+        char command = toupper((char)ch);
+        if (command == '\n' || command == '\r' || command == '\0') continue;
+        if (command == 'Q') {
+            *quits = true;
+            break;
         }
-        board = new_board;
-        
-        // Make a copy for drawing (we'll draw outside the lock)
-        Board board_copy = board;
-        board_copy.data = NULL; // Will allocate separately
-        if (board.data) {
-            size_t data_size = board.width * board.height;
-            board_copy.data = malloc(data_size + 1);
-            if (board_copy.data) {
-                memcpy(board_copy.data, board.data, data_size + 1);
+        if (*len == capacity) {
+            capacity *= 2;
+            char *grown = realloc(script, capacity);
+            if (!grown) {
+                free(script);
+                return NULL;
             }
+            script = grown;
         }
-        pthread_mutex_unlock(&mutex);
+        script[(*len)++] = command;
+    }
+    return script;
+}
 
-        // Draw outside the lock to avoid holding it too long
-        if (board_copy.data) {
-            draw_board_client(board_copy);
-            refresh_screen();
-            free(board_copy.data);
+int main(int argc, char *argv[]) {
+    if (argc == 4 && strcmp(argv[1], "--resize") == 0) {
+        int max_games = atoi(argv[2]);
+        if (max_games <= 0 || pacman_admin_resize(argv[3], max_games) != 0) {
+            fprintf(stderr, "Failed to resize the server to %s games\n", argv[2]);
+            return 1;
         }
+        return 0;
     }
 
-    debug("Returning receiver thread...\n");
-    return NULL;
-}
+    // Positional arguments, with optional flags anywhere
+    const char *positional[3] = {NULL, NULL, NULL};
+    int n_positional = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--predict") == 0) {
+            predict = true;
+        } else if (n_positional < 3) {
+            positional[n_positional++] = argv[i];
+        } else {
+            n_positional = -1;
+            break;
+        }
+    }
 
-int main(int argc, char *argv[]) {
-    if (argc != 3 && argc != 4) {
+    if (n_positional != 2 && n_positional != 3) {
         fprintf(stderr,
-            "Usage: %s <client_id> <register_pipe> [commands_file]\n",
-            argv[0]);
+            "Usage: %s <client_id> <register_pipe> [commands_file] [--predict]\n"
+            "       %s --resize <max_games> <register_pipe>\n",
+            argv[0], argv[0]);
         return 1;
     }
 
-    const char *client_id = argv[1];
-    const char *register_pipe = argv[2];
-    const char *commands_file = (argc == 4) ? argv[3] : NULL;
+    const char *client_id = positional[0];
+    const char *register_pipe = positional[1];
+    const char *commands_file = positional[2];
 
-    FILE *cmd_fp = NULL;
+    char *script = NULL;
+    int script_len = 0;
+    bool script_quits = false;
     if (commands_file) {
-        cmd_fp = fopen(commands_file, "r");
+        FILE *cmd_fp = fopen(commands_file, "r");
         if (!cmd_fp) {
             perror("Failed to open commands file");
             return 1;
         }
+        script = load_script(cmd_fp, &script_len, &script_quits);
+        fclose(cmd_fp);
+        if (!script) {
+            fprintf(stderr, "Failed to read commands file\n");
+            return 1;
+        }
     }
 
     char req_pipe_path[MAX_PIPE_PATH_LENGTH];
@@ -106,65 +217,54 @@ int main(int argc, char *argv[]) {
 
     open_debug_file("client-debug.log");
 
-    if (pacman_connect(req_pipe_path, notif_pipe_path, register_pipe) != 0) {
+    pacman_session_t *session = pacman_open(req_pipe_path, notif_pipe_path, register_pipe);
+    if (!session) {
         perror("Failed to connect to server");
         return 1;
     }
 
-    pthread_t receiver_thread_id;
-    pthread_create(&receiver_thread_id, NULL, receiver_thread, NULL);
+    if (predict) prediction_init(&prediction, session);
+
+    pacman_callbacks_t callbacks = {
+        .on_board = on_board,
+        .on_game_over = on_game_over,
+        .on_disconnect = on_disconnect,
+    };
+    pacman_set_callbacks(session, &callbacks, NULL);
 
     terminal_init();
-    set_timeout(500);
-    
-    pthread_mutex_lock(&mutex);
-    Board board_copy = board;
-    pthread_mutex_unlock(&mutex);
-    
-    draw_board_client(board_copy);
-    refresh_screen();
+    // Input is read only when poll reports it, getch must not block
+    set_timeout(0);
 
     char command;
-    int ch;
-
-    while (1) {
 
-        pthread_mutex_lock(&mutex);
-        if (stop_execution) {
-            pthread_mutex_unlock(&mutex);
-            break;
-        }
-        pthread_mutex_unlock(&mutex);
+    while (!stop_execution) {
 
-        if (cmd_fp) {
-            // Input from file
-            ch = fgetc(cmd_fp);
+        if (script) {
+            // The server plays one command per turn and paces the script:
+            // batches are only sent as it acks the previous ones
+            if (!feed_script(session, script, script_len, script_quits)) break;
 
-            if (ch == EOF) {
-                // Restart at the start of the file
-                rewind(cmd_fp);
-                continue;
+            if (script_quits && (script_len == 0 || (script_sent && acked_batch == next_batch - 1))) {
+                debug("Commands file quits, leaving game\n");
+                break;
             }
+            wait_and_render(session, FRAME_INTERVAL_MS);
+            continue;
+        }
 
-            command = (char)ch;
-
-            if (command == '\n' || command == '\r' || command == '\0')
-                continue;
-
-            command = toupper(command);
-            
-            // Wait for tempo, to not overflow pipe with requests
-            pthread_mutex_lock(&mutex);
-            int wait_for = tempo;
-            pthread_mutex_unlock(&mutex);
+        // Event loop: sleep until a frame or a key arrives (or the next render tick)
+        struct pollfd fds[2] = {
+            { .fd = pacman_notification_fd(session), .events = POLLIN },
+            { .fd = STDIN_FILENO, .events = POLLIN },
+        };
+        poll(fds, 2, FRAME_INTERVAL_MS);
+        pacman_poll(session, 0);
+        render_latest_frame(session);
+        if (stop_execution) break;
 
-            sleep_ms(wait_for);
-            
-        } else {
-            // Interactive input
-            command = get_input();
-            command = toupper(command);
-        }
+        // Interactive input
+        command = toupper(get_input());
 
         if (command == '\0')
             continue;
@@ -176,26 +276,25 @@ int main(int argc, char *argv[]) {
 
         debug("Command: %c\n", command);
 
-        pacman_play(command);
+        if (predict) {
+            // Shown on the next local frame, without waiting for the server
+            prediction_input(&prediction, command);
+            prediction_dirty = true;
+        } else {
+            pacman_play(session, command);
+        }
 
     }
 
-    pacman_disconnect();
+    pacman_disconnect(session);
+    pacman_close(session);
 
-    pthread_join(receiver_thread_id, NULL);
+    clear();
+    refresh();
 
-    if (cmd_fp)
-        fclose(cmd_fp);
+    free(script);
 
-    // Clean up board data
-    pthread_mutex_lock(&mutex);
-    if (board.data) {
-        free(board.data);
-        board.data = NULL;
-    }
-    pthread_mutex_unlock(&mutex);
-    
-    pthread_mutex_destroy(&mutex);
+    if (predict) prediction_destroy(&prediction);
 
     terminal_cleanup();
 
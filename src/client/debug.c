@@ -3,6 +3,7 @@
 #include <unistd.h>
 #include <stdarg.h>
 #include <time.h>
+#include <errno.h>
 
 FILE * debugfile;
 
@@ -15,6 +16,9 @@ void close_debug_file() {
 }
 
 void debug(const char * format, ...) {
+    // Libraries built on board.c may run without a debug file
+    if (!debugfile) return;
+
     va_list args;
     va_start(args, format);
     vfprintf(debugfile, format, args);
@@ -27,5 +31,6 @@ void sleep_ms(int milliseconds) {
     struct timespec ts;
     ts.tv_sec = milliseconds / 1000;
     ts.tv_nsec = (milliseconds % 1000) * 1000000;
-    nanosleep(&ts, NULL);
+    // A signal cuts the sleep short: sleep the remainder
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR) {}
 }
\ No newline at end of file
@@ -1,6 +1,7 @@
 #include "display.h"
 #include "board.h"
 #include "api.h"
+#include "protocol.h"
 #include <stdlib.h>
 #include <ctype.h>
 
@@ -47,92 +48,118 @@ int terminal_init() {
 }
 
 
-void draw_board_client(Board board) {
-    // Clear the screen before redrawing
-    clear();
+// Last frame put on the screen by draw_board_client (for dirty-cell diffing)
+static char drawn_cells[MAX_BOARD_CELLS];
+static int drawn_width = -1, drawn_height = -1;
+static int drawn_status = -1, drawn_points = -1;
 
-    // Draw the border/title
-    attron(COLOR_PAIR(5));
-    mvprintw(0, 0, "=== PACMAN GAME ===");
-    if (board.game_over) {
-        mvprintw(1, 0, " GAME OVER ");
-    } else if (board.victory) {
-        mvprintw(1, 0, " VICTORY ");
-    } else {
-        mvprintw(1, 0, " Use W/A/S/D to move | Q to quit");
+void display_invalidate() {
+    drawn_width = drawn_height = -1;
+}
+
+// Character and attributes used to draw a cell of a client frame
+static chtype cell_attributes(char ch, char *out_char) {
+    *out_char = ch;
+    switch (ch) {
+        case '#': return COLOR_PAIR(3);                      // Wall
+        case 'C': return COLOR_PAIR(1) | A_BOLD;             // Pacman
+        case 'M': return COLOR_PAIR(2) | A_BOLD;             // Monster/Ghost
+        case 'G': *out_char = 'M';                           // Charged Monster/Ghost
+                  return COLOR_PAIR(2) | A_BOLD | A_DIM;
+        case '.': return COLOR_PAIR(4);                      // Dot
+        case '@': return COLOR_PAIR(6);                      // Portal
+        default:  return A_NORMAL;                           // Empty space and others
     }
+}
+
+void draw_board_client(Board board) {
+    draw_board_frame(board, " Use W/A/S/D to move | Q to quit");
+}
 
+void draw_board_frame(Board board, const char *menu) {
     // Starting row for the game board (leave space for UI)
     int start_row = 3;
+    int cells = board.width * board.height;
+    int full_redraw = board.width != drawn_width || board.height != drawn_height || cells > MAX_BOARD_CELLS;
 
-    // Draw the board
-    for (int y = 0; y < board.height; y++) {
-        for (int x = 0; x < board.width; x++) {
-            char ch = board.data[y * board.width + x];
-
-            // Move cursor to position
-            move(start_row + y, x);
-
-            // Draw with appropriate color
-            switch (ch) {
-                case '#': // Wall
-                    attron(COLOR_PAIR(3));
-                    addch('#');
-                    attroff(COLOR_PAIR(3));
-                    break;
-
-                case 'C': // Pacman
-                    attron(COLOR_PAIR(1) | A_BOLD);
-                    addch('C');
-                    attroff(COLOR_PAIR(1) | A_BOLD);
-                    break;
-
-                case 'M': // Monster/Ghost
-                    attron(COLOR_PAIR(2) | A_BOLD);
-                    addch('M');
-                    attroff(COLOR_PAIR(2) | A_BOLD);  
-                    break;
-
-                case 'G': // Charged Monster/Ghost
-                    attron((COLOR_PAIR(2) | A_BOLD) | A_DIM);
-                    addch('M');
-                    attroff((COLOR_PAIR(2) | A_BOLD) | A_DIM);  
-                    break;
-
-                case '.': // Dot
-                    attron(COLOR_PAIR(4));
-                    addch('.');
-                    attroff(COLOR_PAIR(4));
-                    break;
+    if (full_redraw) {
+        // Only a new board shape wipes the screen, every other frame is a diff
+        clear();
+        drawn_status = drawn_points = -1;
+    }
 
-                case '@': // Portal
-                    attron(COLOR_PAIR(6));
-                    addch('@');
-                    attroff(COLOR_PAIR(6));
-                    break;
+    // Draw the border/title
+    int status = board.game_over ? 1 : (board.victory ? 2 : 0);
+    if (status != drawn_status) {
+        attron(COLOR_PAIR(5));
+        mvprintw(0, 0, "=== PACMAN GAME ===");
+        move(1, 0);
+        clrtoeol();
+        if (board.game_over) {
+            mvprintw(1, 0, " GAME OVER ");
+        } else if (board.victory) {
+            mvprintw(1, 0, " VICTORY ");
+        } else {
+            mvprintw(1, 0, "%s", menu);
+        }
+        attroff(COLOR_PAIR(5));
+        drawn_status = status;
+    }
 
-                case ' ': // Empty space
-                    addch(' ');
-                    break;
+    // Redraw only changed cells, batching runs that share the same attributes
+    char run[MAX_BOARD_CELLS + 1];
+    for (int y = 0; y < board.height; y++) {
+        int x = 0;
+        while (x < board.width) {
+            int idx = y * board.width + x;
+            if (!full_redraw && drawn_cells[idx] == board.data[idx]) {
+                x++;
+                continue;
+            }
 
-                default:
-                    addch(ch);
-                    break;
+            char out_char;
+            chtype attrs = cell_attributes(board.data[idx], &out_char);
+            int run_start = x;
+            int run_len = 0;
+            while (x < board.width) {
+                idx = y * board.width + x;
+                if (!full_redraw && drawn_cells[idx] == board.data[idx]) break;
+                char next_char;
+                if (cell_attributes(board.data[idx], &next_char) != attrs) break;
+                run[run_len++] = next_char;
+                if (cells <= MAX_BOARD_CELLS) drawn_cells[idx] = board.data[idx];
+                x++;
             }
+
+            attron(attrs);
+            mvaddnstr(start_row + y, run_start, run, run_len);
+            attroff(attrs);
         }
     }
 
+    drawn_width = cells <= MAX_BOARD_CELLS ? board.width : -1;
+    drawn_height = board.height;
+
     // Draw score/status at the bottom
-    attron(COLOR_PAIR(5));
-    mvprintw(start_row + board.height + 1, 0, "Points: %d",
-             board.accumulated_points);
-    attroff(COLOR_PAIR(5));
+    if (board.accumulated_points != drawn_points) {
+        attron(COLOR_PAIR(5));
+        mvprintw(start_row + board.height + 1, 0, "Points: %d",
+                 board.accumulated_points);
+        clrtoeol();
+        attroff(COLOR_PAIR(5));
+        drawn_points = board.accumulated_points;
+    }
 }
 
 // Does exaclty the same as draw board but stores the output in a string instead of printing it
 char* get_board_displayed(board_t* board) {
     size_t buffer_size = (board->width  * board->height) + 1;
     char* output = malloc(buffer_size);
+    if (output) fill_board_displayed(board, output);
+    return output;
+}
+
+void fill_board_displayed(board_t* board, char* output) {
     size_t pos = 0;
     for (int y = 0; y < board->height; y++) {
         for (int x = 0; x < board->width; x++) {
@@ -186,7 +213,6 @@ char* get_board_displayed(board_t* board) {
     }
     
     output[pos] = '\0';
-    return output;
 }
 
 void draw_board(board_t* board, int mode) {
@@ -206,7 +232,7 @@ void draw_board(board_t* board, int mode) {
         break;
 
     case DRAW_MENU:
-        mvprintw(1, 0, "Level: %s | Use W/A/S/D to move | Q to quit | G to quicksave ", board->level_name);
+        mvprintw(1, 0, "Level: %s | Use W/A/S/D to move | Q to quit | G to quicksave ", board->level->name);
         break;
     }
 
@@ -0,0 +1,154 @@
+#include "prediction.h"
+#include "debug.h"
+#include <stdlib.h>
+#include <string.h>
+
+void prediction_init(prediction_t *p, pacman_session_t *session) {
+    memset(p, 0, sizeof(*p));
+    p->session = session;
+    p->next_seq = 1;
+    p->frame.data = p->frame_data;
+    p->board.n_pacmans = 1;
+    p->board.pacmans = calloc(1, sizeof(pacman_t));
+    p->board.n_ghosts = 0; // Ghosts are not simulated, they stay where the server put them
+    p->board.ghosts = NULL;
+}
+
+void prediction_destroy(prediction_t *p) {
+    free(p->board.board);
+    free(p->board.pacmans);
+    p->board.board = NULL;
+    p->board.pacmans = NULL;
+    p->cells_capacity = 0;
+}
+
+// Rebuilds the local board from an authoritative frame
+static int load_frame(prediction_t *p, const Board *frame) {
+    board_t *board = &p->board;
+    int cells = frame->width * frame->height;
+    if (cells <= 0 || cells > MAX_BOARD_CELLS || !board->pacmans) return -1;
+
+    // Cells are only reallocated when the board grows
+    if (cells > p->cells_capacity) {
+        board_pos_t *grown = realloc(board->board, cells * sizeof(board_pos_t));
+        if (!grown) return -1;
+        board->board = grown;
+        p->cells_capacity = cells;
+    }
+
+    board->width = frame->width;
+    board->height = frame->height;
+    board->tempo = frame->tempo;
+
+    pacman_t *pac = &board->pacmans[0];
+    memset(pac, 0, sizeof(*pac));
+    pac->points = frame->accumulated_points;
+
+    int found = 0;
+    for (int i = 0; i < cells; i++) {
+        board_pos_t *cell = &board->board[i];
+        char ch = frame->data[i];
+        cell->has_dot = (ch == '.');
+        cell->has_portal = (ch == '@');
+        switch (ch) {
+            case '#': cell->content = 'W'; break;
+            case 'M':
+            case 'G': cell->content = 'M'; break;
+            case 'C':
+                cell->content = 'P';
+                pac->pos_x = i % frame->width;
+                pac->pos_y = i / frame->width;
+                found = 1;
+                break;
+            default: cell->content = ' '; break;
+        }
+    }
+    pac->alive = found && !frame->game_over;
+
+    // Header fields of the predicted frame follow the authoritative one
+    p->frame.width = frame->width;
+    p->frame.height = frame->height;
+    p->frame.tempo = frame->tempo;
+    p->frame.victory = frame->victory;
+    p->frame.ack_seq = frame->ack_seq;
+    p->frame.dropped_commands = frame->dropped_commands;
+    return 0;
+}
+
+// Serializes the local board with the same characters the server uses
+static void render_prediction(prediction_t *p) {
+    board_t *board = &p->board;
+    int cells = board->width * board->height;
+    for (int i = 0; i < cells; i++) {
+        board_pos_t *cell = &board->board[i];
+        char out_char;
+        switch (cell->content) {
+            case 'W': out_char = '#'; break;
+            case 'P': out_char = 'C'; break;
+            case 'M': out_char = 'M'; break;
+            default:
+                if (cell->has_dot) out_char = '.';
+                else if (cell->has_portal) out_char = '@';
+                else out_char = ' ';
+                break;
+        }
+        p->frame_data[i] = out_char;
+    }
+    p->frame_data[cells] = '\0';
+    p->frame.accumulated_points = board->pacmans[0].points;
+    p->frame.game_over = !board->pacmans[0].alive;
+}
+
+static void apply_input(prediction_t *p, char command) {
+    command_t cmd = { .command = command, .turns = 1 };
+    move_pacman(&p->board, 0, &cmd);
+}
+
+void prediction_input(prediction_t *p, char command) {
+    int seq = p->next_seq++;
+
+    // A stalled server should not make the queue grow forever: forget the oldest input
+    if (p->n_pending == MAX_PENDING_INPUTS) {
+        memmove(p->pending, p->pending + 1, (MAX_PENDING_INPUTS - 1) * sizeof(char));
+        memmove(p->pending_seq, p->pending_seq + 1, (MAX_PENDING_INPUTS - 1) * sizeof(int));
+        p->n_pending--;
+    }
+    p->pending[p->n_pending] = command;
+    p->pending_seq[p->n_pending] = seq;
+    p->n_pending++;
+
+    if (p->ready) {
+        apply_input(p, command);
+        render_prediction(p);
+    }
+
+    pacman_play_seq(p->session, command, seq);
+}
+
+void prediction_reconcile(prediction_t *p, const Board *frame) {
+    // Drop the inputs this frame already contains
+    int acked = 0;
+    while (acked < p->n_pending && p->pending_seq[acked] <= frame->ack_seq) acked++;
+    if (acked > 0) {
+        memmove(p->pending, p->pending + acked, (p->n_pending - acked) * sizeof(char));
+        memmove(p->pending_seq, p->pending_seq + acked, (p->n_pending - acked) * sizeof(int));
+        p->n_pending -= acked;
+    }
+
+    if (load_frame(p, frame) != 0) {
+        debug("Prediction: invalid frame %dx%d\n", frame->width, frame->height);
+        return;
+    }
+
+    // Roll forward: replay what the server has not applied yet
+    for (int i = 0; i < p->n_pending; i++) {
+        apply_input(p, p->pending[i]);
+    }
+
+    p->ready = 1;
+    render_prediction(p);
+}
+
+const Board* prediction_frame(prediction_t *p) {
+    return p->ready ? &p->frame : NULL;
+}
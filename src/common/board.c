@@ -1,12 +1,20 @@
 #include "board.h"
 #include "parser.h"
+#include "lockprof.h"
 #include <stdlib.h>
+#include <string.h>
 #include <stdio.h> 
 #include <fcntl.h>
 #include <time.h>
 #include <unistd.h>
 #include <stdarg.h>
 #include <pthread.h>
+#include <stdatomic.h>
+
+// Cell locks guard boards moved by several threads (the standalone game's
+// pacman and ghost threads); a board with a single writer has none
+#define cell_lock(b, i) do { if ((b)->cell_locks) prof_mutex_lock(LOCK_CLASS_CELL, &(b)->cell_locks[i]); } while (0)
+#define cell_unlock(b, i) do { if ((b)->cell_locks) prof_mutex_unlock(&(b)->cell_locks[i]); } while (0)
 
 // Helper private function to find and kill pacman at specific position
 static int find_and_kill_pacman(board_t* board, int new_x, int new_y) {
@@ -21,6 +29,30 @@ static int find_and_kill_pacman(board_t* board, int new_x, int new_y) {
     return VALID_MOVE;
 }
 
+// Helper private function returning the next number of the board's SplitMix64 stream.
+// Each board owns its counter, so sessions never contend on libc's locked rand();
+// the relaxed fetch_add keeps it safe for the standalone game's ghost threads
+static uint32_t board_random(board_t* board) {
+    uint64_t z = atomic_fetch_add_explicit(&board->rng_state, 0x9E3779B97F4A7C15ULL, memory_order_relaxed)
+                 + 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return (uint32_t)((z ^ (z >> 31)) >> 32);
+}
+
+void seed_board_rng(board_t* board, uint64_t seed) {
+    board->seed = seed;
+    atomic_store_explicit(&board->rng_state, seed, memory_order_relaxed);
+}
+
+uint64_t level_seed(uint64_t seed, int level) {
+    // One SplitMix64 step over (seed, level): neighbouring levels get unrelated streams
+    uint64_t z = seed + (uint64_t)(level + 1) * 0x9E3779B97F4A7C15ULL;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
 // Helper private function for getting board position index
 static inline int get_board_index(board_t* board, int x, int y) {
     return y * board->width + x;
@@ -31,7 +63,7 @@ static inline int is_valid_position(board_t* board, int x, int y) {
     return (x >= 0 && x < board->width) && (y >= 0 && y < board->height); // Inside of the board boundaries
 }
 
-int move_pacman(board_t* board, int pacman_index, command_t* command) {
+int move_pacman(board_t* board, int pacman_index, const command_t* command) {
     if (pacman_index < 0 || !board->pacmans[pacman_index].alive) {
         return DEAD_PACMAN; // Invalid or dead pacman
     }
@@ -51,7 +83,7 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
 
     if (direction == 'R') {
         char directions[] = {'W', 'S', 'A', 'D'};
-        direction = directions[rand() % 4];
+        direction = directions[board_random(board) % 4];
     }
 
     // Calculate new position based on direction
@@ -69,11 +101,12 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
             new_x++;
             break;
         case 'T': // Wait
-            if (command->turns_left == 1) {
+            if (pac->turns_left == 0) pac->turns_left = command->turns; // first turn of the wait
+            if (pac->turns_left <= 1) {
                 pac->current_move += 1; // move on
-                command->turns_left = command->turns;
+                pac->turns_left = 0;
             }
-            else command->turns_left -= 1;
+            else pac->turns_left -= 1;
             return VALID_MOVE;
         default:
             return INVALID_MOVE; // Invalid direction
@@ -92,12 +125,12 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
 
     // locks
     if (old_index < new_index) {
-        pthread_mutex_lock(&board->board[old_index].lock);
-        pthread_mutex_lock(&board->board[new_index].lock);
+        cell_lock(board, old_index);
+        cell_lock(board, new_index);
     }
     else {
-        pthread_mutex_lock(&board->board[new_index].lock);
-        pthread_mutex_lock(&board->board[old_index].lock);
+        cell_lock(board, new_index);
+        cell_lock(board, old_index);
     }
 
     char target_content = board->board[new_index].content;
@@ -108,12 +141,12 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
         
         // Unlock antes de retornar
         if (old_index < new_index) {
-            pthread_mutex_unlock(&board->board[old_index].lock);
-            pthread_mutex_unlock(&board->board[new_index].lock);
+            cell_unlock(board, old_index);
+            cell_unlock(board, new_index);
         }
         else {
-            pthread_mutex_unlock(&board->board[new_index].lock);
-            pthread_mutex_unlock(&board->board[old_index].lock);
+            cell_unlock(board, new_index);
+            cell_unlock(board, old_index);
         }
         return REACHED_PORTAL;
     }
@@ -141,35 +174,35 @@ int move_pacman(board_t* board, int pacman_index, command_t* command) {
     board->board[new_index].content = 'P';
 
     if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
+        cell_unlock(board, old_index);
+        cell_unlock(board, new_index);
     }
     else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
+        cell_unlock(board, new_index);
+        cell_unlock(board, old_index);
     }
     
     return VALID_MOVE;
 
     move_pacman_invalid:
     if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
+        cell_unlock(board, old_index);
+        cell_unlock(board, new_index);
     }
     else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
+        cell_unlock(board, new_index);
+        cell_unlock(board, old_index);
     }
     return INVALID_MOVE;
 
     move_pacman_dead:
     if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
+        cell_unlock(board, old_index);
+        cell_unlock(board, new_index);
     }
     else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
+        cell_unlock(board, new_index);
+        cell_unlock(board, old_index);
     }
     return DEAD_PACMAN;
 }
@@ -191,7 +224,7 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
             if (y == 0) return INVALID_MOVE;
 
             for (int i = 0; i <= y; i++) {
-                pthread_mutex_lock(&board->board[i * board->width + x].lock);
+                cell_lock(board, i * board->width + x);
             }
 
             new_y = 0; // In case there is no colision
@@ -210,14 +243,14 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
             }
 
             for (int i = 0; i <= y; i++) {
-                pthread_mutex_unlock(&board->board[i * board->width + x].lock);
+                cell_unlock(board, i * board->width + x);
             }
             break;
         case 'S':
             if (y == board->height - 1) return INVALID_MOVE;
 
             for (int i = y; i < board->height; i++) {
-                pthread_mutex_lock(&board->board[i * board->width + x].lock);
+                cell_lock(board, i * board->width + x);
             }
 
             new_y = board->height - 1; // In case there is no colision
@@ -236,14 +269,14 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
             }
 
             for (int i = y; i < board->height; i++) {
-                pthread_mutex_unlock(&board->board[i * board->width + x].lock);
+                cell_unlock(board, i * board->width + x);
             }
             break;
         case 'A':
             if (x == 0) return INVALID_MOVE;
 
             for (int j = 0; j <= x; j++) {
-                pthread_mutex_lock(&board->board[y * board->width + j].lock);
+                cell_lock(board, y * board->width + j);
             }
 
             new_x = 0; // In case there is no colision
@@ -262,14 +295,14 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
             }
 
             for (int j = 0; j <= x; j++) {
-                pthread_mutex_unlock(&board->board[y * board->width + j].lock);
+                cell_unlock(board, y * board->width + j);
             }
             break;
         case 'D':
             if (x == board->width - 1) return INVALID_MOVE;
 
             for (int j = x; j < board->width; j++) {
-                pthread_mutex_lock(&board->board[y * board->width + j].lock);
+                cell_lock(board, y * board->width + j);
             }
 
             new_x = board->width - 1; // In case there is no colision
@@ -288,7 +321,7 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
             }
 
             for (int j = x; j < board->width; j++) {
-                pthread_mutex_unlock(&board->board[y * board->width + j].lock);
+                cell_unlock(board, y * board->width + j);
             }
             break;
         default:
@@ -307,23 +340,49 @@ int move_ghost_charged(board_t* board, int ghost_index, char direction) {
     return result;
 }
 
-int move_ghost(board_t* board, int ghost_index, command_t* command) {
-    ghost_t* ghost = &board->ghosts[ghost_index];
-    int new_x = ghost->pos_x;
-    int new_y = ghost->pos_y;
-
+// Helper private function playing the tick if it leaves the board as it is (a passo
+// wait, 'C' or a 'T' turn) and returning 1, or returning 0 without changing anything.
+// move_ghost and the idle helpers share it, so parked boards skip exactly these ticks
+static int ghost_quiet_step(ghost_t* ghost, const command_t* command) {
     // check passo
     if (ghost->waiting > 0) {
         ghost->waiting -= 1;
-        return VALID_MOVE;
+        return 1;
     }
+
+    switch (command->command) {
+        case 'C': // Charge
+            ghost->waiting = ghost->passo;
+            ghost->current_move += 1;
+            ghost->charged = 1;
+            return 1;
+        case 'T': // Wait
+            ghost->waiting = ghost->passo;
+            if (ghost->turns_left == 0) ghost->turns_left = command->turns; // first turn of the wait
+            if (ghost->turns_left <= 1) {
+                ghost->current_move += 1; // move on
+                ghost->turns_left = 0;
+            }
+            else ghost->turns_left -= 1;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+int move_ghost(board_t* board, int ghost_index, const command_t* command) {
+    ghost_t* ghost = &board->ghosts[ghost_index];
+    int new_x = ghost->pos_x;
+    int new_y = ghost->pos_y;
+
+    if (ghost_quiet_step(ghost, command)) return VALID_MOVE;
     ghost->waiting = ghost->passo;
 
     char direction = command->command;
 
     if (direction == 'R') {
         char directions[] = {'W', 'S', 'A', 'D'};
-        direction = directions[rand() % 4];
+        direction = directions[board_random(board) % 4];
     }
 
     // Calculate new position based on direction
@@ -340,17 +399,6 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
         case 'D': // Right
             new_x++;
             break;
-        case 'C': // Charge
-            ghost->current_move += 1;
-            ghost->charged = 1;
-            return VALID_MOVE;
-        case 'T': // Wait
-            if (command->turns_left == 1) {
-                ghost->current_move += 1; // move on
-                command->turns_left = command->turns;
-            }
-            else command->turns_left -= 1;
-            return VALID_MOVE;
         default:
             return INVALID_MOVE; // Invalid direction
     }
@@ -371,12 +419,12 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
 
     // locks
     if (old_index < new_index) {
-        pthread_mutex_lock(&board->board[old_index].lock);
-        pthread_mutex_lock(&board->board[new_index].lock);
+        cell_lock(board, old_index);
+        cell_lock(board, new_index);
     }
     else {
-        pthread_mutex_lock(&board->board[new_index].lock);
-        pthread_mutex_lock(&board->board[old_index].lock);
+        cell_lock(board, new_index);
+        cell_lock(board, old_index);
     }
 
     char target_content = board->board[new_index].content;
@@ -414,28 +462,73 @@ int move_ghost(board_t* board, int ghost_index, command_t* command) {
     board->board[new_index].content = 'M';
 
     if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
+        cell_unlock(board, old_index);
+        cell_unlock(board, new_index);
     }
     else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
+        cell_unlock(board, new_index);
+        cell_unlock(board, old_index);
     }
     
     return result;
 
     move_ghost_invalid:
     if (old_index < new_index) {
-        pthread_mutex_unlock(&board->board[old_index].lock);
-        pthread_mutex_unlock(&board->board[new_index].lock);
+        cell_unlock(board, old_index);
+        cell_unlock(board, new_index);
     }
     else {
-        pthread_mutex_unlock(&board->board[new_index].lock);
-        pthread_mutex_unlock(&board->board[old_index].lock);
+        cell_unlock(board, new_index);
+        cell_unlock(board, old_index);
     }
     return INVALID_MOVE;
 }
 
+int move_ghosts(board_t* board) {
+    int result = VALID_MOVE;
+    for (int i = 0; i < board->n_ghosts; i++) {
+        ghost_t* ghost = &board->ghosts[i];
+        if (ghost->n_moves > 0 &&
+            move_ghost(board, i, &ghost->moves[ghost->current_move % ghost->n_moves]) == DEAD_PACMAN) {
+            result = DEAD_PACMAN;
+        }
+    }
+    return result;
+}
+
+int board_quiet_ticks(const board_t* board, int limit) {
+    int quiet = limit;
+    for (int i = 0; i < board->n_ghosts && quiet > 0; i++) {
+        const ghost_t* ghost = &board->ghosts[i];
+        if (ghost->n_moves <= 0) continue; // never moves
+        // Played on a copy, the board is only read
+        ghost_t copy = *ghost;
+        int k = 0;
+        while (k < quiet && ghost_quiet_step(&copy, &copy.moves[copy.current_move % copy.n_moves])) k++;
+        quiet = k;
+    }
+    return quiet;
+}
+
+void board_skip_ticks(board_t* board, int ticks) {
+    for (int i = 0; i < board->n_ghosts; i++) {
+        ghost_t* ghost = &board->ghosts[i];
+        if (ghost->n_moves <= 0) continue;
+        for (int k = 0; k < ticks; k++) {
+            if (!ghost_quiet_step(ghost, &ghost->moves[ghost->current_move % ghost->n_moves])) break;
+        }
+    }
+}
+
+int board_step(board_t* board, const command_t* pacman_command) {
+    // Fixed order: pacman first, then the ghosts in index order
+    if (pacman_command && board->n_pacmans > 0) {
+        int result = move_pacman(board, 0, pacman_command);
+        if (result == REACHED_PORTAL || result == DEAD_PACMAN) return result;
+    }
+    return move_ghosts(board) == DEAD_PACMAN ? DEAD_PACMAN : VALID_MOVE;
+}
+
 void kill_pacman(board_t* board, int pacman_index) {
     debug("Killing %d pacman\n\n", pacman_index);
     pacman_t* pac = &board->pacmans[pacman_index];
@@ -469,39 +562,184 @@ int load_ghost(board_t* board) {
     return 0;
 }
 
-int load_level(board_t *board, char *filename, char* dirname, int points) {
+level_t* level_load(char* filename, char* dirname) {
+    level_t* level = calloc(1, sizeof(level_t));
+    if (!level) return NULL;
+    atomic_init(&level->refs, 1);
 
-    if (read_level(board, filename, dirname) < 0) {
+    if (read_level(level, filename, dirname) < 0) {
         printf("Failed to load level\n");
-        return -1;
+        level_release(level);
+        return NULL;
     }
 
-    if (read_pacman(board, points) < 0) {
+    if (read_pacman(level) < 0) {
         printf("Failed to load the pacman\n");
     }
 
-    if (read_ghosts(board) < 0) {
+    if (read_ghosts(level) < 0) {
         printf("Failed to read ghosts\n");
     }
 
+    return level;
+}
+
+void level_retain(level_t* level) {
+    atomic_fetch_add_explicit(&level->refs, 1, memory_order_relaxed);
+}
+
+void level_release(level_t* level) {
+    if (!level || atomic_fetch_sub_explicit(&level->refs, 1, memory_order_acq_rel) != 1) return;
+    free(level->grid);
+    free(level->pacmans);
+    free(level->ghosts);
+    free(level->ghost_scripts);
+    free(level);
+}
+
+// Helper private function copying the level's dimensions and taking a reference to it
+static void board_attach(board_t* board, level_t* level) {
+    board->width = level->width;
+    board->height = level->height;
+    board->tempo = level->tempo;
+    board->n_pacmans = level->n_pacmans;
+    board->n_ghosts = level->n_ghosts;
+    level_retain(level);
+    board->level = level;
+}
+
+int board_init(board_t* board, level_t* level, int accumulated_points) {
+    board->board = calloc(level->width * level->height, sizeof(board_pos_t));
+    board->pacmans = calloc(level->n_pacmans, sizeof(pacman_t));
+    board->ghosts = calloc(level->n_ghosts > 0 ? level->n_ghosts : 1, sizeof(ghost_t));
+    if (!board->board || !board->pacmans || !board->ghosts) {
+        free(board->board);
+        free(board->pacmans);
+        free(board->ghosts);
+        return -1;
+    }
+
+    board_attach(board, level);
+
+    // Deterministic default, callers reseed per session/game
+    seed_board_rng(board, 0);
+
     pthread_rwlock_init(&board->state_lock, NULL);
+    board->cell_locks = NULL;
 
+    board_reset(board, accumulated_points);
+    return 0;
+}
+
+void board_reset(board_t* board, int accumulated_points) {
+    level_t* level = board->level;
     for (int i = 0; i < board->height * board->width; i++) {
-        pthread_mutex_init(&board->board[i].lock, NULL);
+        char cell = level->grid[i];
+        board->board[i].content = cell == 'W' ? 'W' : ' ';
+        board->board[i].has_dot = cell == '.';
+        board->board[i].has_portal = cell == '@';
     }
 
-    //print_board(board);
+    memcpy(board->pacmans, level->pacmans, board->n_pacmans * sizeof(pacman_t));
+    memcpy(board->ghosts, level->ghosts, board->n_ghosts * sizeof(ghost_t));
+    for (int p = 0; p < board->n_pacmans; p++) {
+        pacman_t* pac = &board->pacmans[p];
+        pac->points = accumulated_points;
+        board->board[pac->pos_y * board->width + pac->pos_x].content = 'P';
+    }
+    for (int g = 0; g < board->n_ghosts; g++) {
+        ghost_t* ghost = &board->ghosts[g];
+        board->board[ghost->pos_y * board->width + ghost->pos_x].content = 'M';
+    }
+}
+
+int board_arena_init(board_arena_t* arena, int cells, int n_pacmans, int n_ghosts) {
+    memset(arena, 0, sizeof(*arena));
+    board_t* board = &arena->board;
+    board->board = calloc(cells > 0 ? cells : 1, sizeof(board_pos_t));
+    board->pacmans = calloc(n_pacmans > 0 ? n_pacmans : 1, sizeof(pacman_t));
+    board->ghosts = calloc(n_ghosts > 0 ? n_ghosts : 1, sizeof(ghost_t));
+    if (!board->board || !board->pacmans || !board->ghosts) {
+        free(board->board);
+        free(board->pacmans);
+        free(board->ghosts);
+        return -1;
+    }
+
+    arena->cells_capacity = cells;
+    arena->pacmans_capacity = n_pacmans;
+    arena->ghosts_capacity = n_ghosts;
+
+    pthread_rwlock_init(&board->state_lock, NULL);
+    return 0;
+}
+
+void board_arena_destroy(board_arena_t* arena) {
+    board_t* board = &arena->board;
+    if (board->level) board_arena_unload(arena);
+    pthread_rwlock_destroy(&board->state_lock);
+    free(board->board);
+    free(board->pacmans);
+    free(board->ghosts);
+    memset(arena, 0, sizeof(*arena));
+}
+
+board_t* board_arena_load(board_arena_t* arena, level_t* level, int accumulated_points) {
+    if (level->width * level->height > arena->cells_capacity ||
+        level->n_pacmans > arena->pacmans_capacity ||
+        level->n_ghosts > arena->ghosts_capacity) {
+        return NULL;
+    }
+
+    board_t* board = &arena->board;
+    if (board->level) board_arena_unload(arena);
+    board_attach(board, level);
+    seed_board_rng(board, 0);
+    board_reset(board, accumulated_points);
+    return board;
+}
+
+void board_arena_unload(board_arena_t* arena) {
+    level_release(arena->board.level);
+    arena->board.level = NULL;
+}
+
+int board_enable_cell_locks(board_t* board) {
+    int cells = board->width * board->height;
+    pthread_mutex_t* locks = malloc((cells > 0 ? cells : 1) * sizeof(pthread_mutex_t));
+    if (!locks) return -1;
+    for (int i = 0; i < cells; i++) {
+        pthread_mutex_init(&locks[i], NULL);
+    }
+    board->cell_locks = locks;
     return 0;
 }
 
+int load_level(board_t *board, char *filename, char* dirname, int points) {
+    level_t* level = level_load(filename, dirname);
+    if (!level) return -1;
+
+    int result = board_init(board, level, points);
+    level_release(level);
+
+    //print_board(board);
+    return result;
+}
+
 void unload_level(board_t * board) {
     pthread_rwlock_destroy(&board->state_lock);
-    for (int i = 0; i < board->height * board->width; i++) {
-        pthread_mutex_destroy(&board->board[i].lock);
+    if (board->cell_locks) {
+        for (int i = 0; i < board->height * board->width; i++) {
+            pthread_mutex_destroy(&board->cell_locks[i]);
+        }
+        free(board->cell_locks);
+        board->cell_locks = NULL;
     }
     free(board->board);
     free(board->pacmans);
     free(board->ghosts);
+    level_release(board->level);
+    board->level = NULL;
 }
 
 
@@ -521,14 +759,15 @@ void print_board(board_t *board) {
                        "Dimensions: %d x %d\n"
                        "Tempo: %d\n"
                        "Pacman file: %s\n",
-                       getpid(), board->height, board->width, board->tempo, board->pacman_file);
+                       getpid(), board->height, board->width, board->tempo,
+                       board->level ? board->level->pacman_file : "");
 
     offset += snprintf(buffer + offset, sizeof(buffer) - offset,
                        "Monster files (%d):\n", board->n_ghosts);
 
     for (int i = 0; i < board->n_ghosts; i++) {
         offset += snprintf(buffer + offset, sizeof(buffer) - offset,
-                           "  - %s\n", board->ghosts_files[i]);
+                           "  - %s\n", board->level ? board->level->ghosts_files[i] : "");
     }
 
     offset += snprintf(buffer + offset, sizeof(buffer) - offset, "\n=== BOARD ===\n");
@@ -0,0 +1,256 @@
+#include "lockprof.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+#ifdef LOCK_PROFILING
+
+#include <string.h>
+#include <time.h>
+
+#define HISTOGRAM_BUCKETS 40  // 2^39 ns is ~9 minutes
+#define MAX_CALL_SITES 256    // Power of two, open addressing
+#define MAX_HELD_LOCKS 16     // Per thread (two cells + state + session at most today)
+#define TOP_CALL_SITES 10
+
+typedef struct {
+    _Atomic uint64_t acquisitions;
+    _Atomic uint64_t contended;      // Acquisitions that had to block
+    _Atomic uint64_t wait_ns;
+    _Atomic uint64_t hold_ns;
+    _Atomic uint64_t max_wait_ns;
+    _Atomic uint64_t max_hold_ns;
+    _Atomic uint64_t wait_histogram[HISTOGRAM_BUCKETS];
+    _Atomic uint64_t hold_histogram[HISTOGRAM_BUCKETS];
+} lock_stats_t;
+
+// key packs the line over the 48 bit address of the __FILE__ literal (0 = free slot)
+typedef struct {
+    _Atomic uint64_t key;
+    _Atomic int cls;
+    _Atomic uint64_t contended;
+    _Atomic uint64_t wait_ns;
+} call_site_t;
+
+typedef struct {
+    const void *lock;
+    lock_class_t cls;
+    uint64_t since;
+} held_lock_t;
+
+static const char *class_names[LOCK_CLASS_COUNT] = { "session", "state", "cell" };
+
+static lock_stats_t stats[LOCK_CLASS_COUNT];
+static call_site_t call_sites[MAX_CALL_SITES];
+static _Atomic uint64_t dropped_sites = 0;
+static _Atomic uint64_t start_ns = 0;
+
+static _Thread_local held_lock_t held[MAX_HELD_LOCKS];
+static _Thread_local int n_held = 0;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int bucket_of(uint64_t ns) {
+    int bucket = ns ? 64 - __builtin_clzll(ns) : 0;
+    return bucket < HISTOGRAM_BUCKETS ? bucket : HISTOGRAM_BUCKETS - 1;
+}
+
+static void update_max(_Atomic uint64_t *max, uint64_t value) {
+    uint64_t current = atomic_load_explicit(max, memory_order_relaxed);
+    while (value > current &&
+           !atomic_compare_exchange_weak_explicit(max, &current, value, memory_order_relaxed, memory_order_relaxed));
+}
+
+static void record_call_site(lock_class_t cls, const char *file, int line, uint64_t wait) {
+    uint64_t key = ((uint64_t)line << 48) | ((uintptr_t)file & 0xFFFFFFFFFFFFULL);
+    uint64_t slot = (key ^ (key >> 29)) * 0x9E3779B97F4A7C15ULL >> 56;
+    for (int probe = 0; probe < MAX_CALL_SITES; probe++) {
+        call_site_t *site = &call_sites[(slot + probe) & (MAX_CALL_SITES - 1)];
+        uint64_t current = atomic_load_explicit(&site->key, memory_order_acquire);
+        if (current == 0) {
+            // Claim the free slot; on failure current gets the key that won it
+            if (atomic_compare_exchange_strong_explicit(&site->key, &current, key,
+                                                        memory_order_acq_rel, memory_order_acquire)) {
+                current = key;
+            }
+        }
+        if (current != key) continue;
+        atomic_store_explicit(&site->cls, cls, memory_order_relaxed);
+        atomic_fetch_add_explicit(&site->contended, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&site->wait_ns, wait, memory_order_relaxed);
+        return;
+    }
+    atomic_fetch_add_explicit(&dropped_sites, 1, memory_order_relaxed);
+}
+
+static void acquired(lock_class_t cls, const void *lock, int contended, uint64_t wait,
+                     const char *file, int line) {
+    lock_stats_t *s = &stats[cls];
+    if (atomic_load_explicit(&start_ns, memory_order_relaxed) == 0) {
+        uint64_t zero = 0;
+        atomic_compare_exchange_strong(&start_ns, &zero, now_ns());
+    }
+
+    atomic_fetch_add_explicit(&s->acquisitions, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&s->wait_histogram[bucket_of(wait)], 1, memory_order_relaxed);
+    if (contended) {
+        atomic_fetch_add_explicit(&s->contended, 1, memory_order_relaxed);
+        atomic_fetch_add_explicit(&s->wait_ns, wait, memory_order_relaxed);
+        update_max(&s->max_wait_ns, wait);
+        record_call_site(cls, file, line, wait);
+    }
+
+    if (n_held < MAX_HELD_LOCKS) {
+        held[n_held++] = (held_lock_t){ lock, cls, now_ns() };
+    }
+}
+
+static void released(const void *lock) {
+    // Usually the innermost lock, but cells are released in any order
+    for (int i = n_held - 1; i >= 0; i--) {
+        if (held[i].lock != lock) continue;
+        uint64_t hold = now_ns() - held[i].since;
+        lock_stats_t *s = &stats[held[i].cls];
+        atomic_fetch_add_explicit(&s->hold_ns, hold, memory_order_relaxed);
+        atomic_fetch_add_explicit(&s->hold_histogram[bucket_of(hold)], 1, memory_order_relaxed);
+        update_max(&s->max_hold_ns, hold);
+        memmove(&held[i], &held[i + 1], (n_held - i - 1) * sizeof(held_lock_t));
+        n_held--;
+        return;
+    }
+}
+
+int lockprof_mutex_lock(lock_class_t cls, pthread_mutex_t *m, const char *file, int line) {
+    if (pthread_mutex_trylock(m) == 0) {
+        acquired(cls, m, 0, 0, file, line);
+        return 0;
+    }
+    uint64_t begin = now_ns();
+    int result = pthread_mutex_lock(m);
+    if (result == 0) acquired(cls, m, 1, now_ns() - begin, file, line);
+    return result;
+}
+
+int lockprof_mutex_unlock(pthread_mutex_t *m) {
+    released(m);
+    return pthread_mutex_unlock(m);
+}
+
+int lockprof_rwlock_rdlock(lock_class_t cls, pthread_rwlock_t *l, const char *file, int line) {
+    if (pthread_rwlock_tryrdlock(l) == 0) {
+        acquired(cls, l, 0, 0, file, line);
+        return 0;
+    }
+    uint64_t begin = now_ns();
+    int result = pthread_rwlock_rdlock(l);
+    if (result == 0) acquired(cls, l, 1, now_ns() - begin, file, line);
+    return result;
+}
+
+int lockprof_rwlock_wrlock(lock_class_t cls, pthread_rwlock_t *l, const char *file, int line) {
+    if (pthread_rwlock_trywrlock(l) == 0) {
+        acquired(cls, l, 0, 0, file, line);
+        return 0;
+    }
+    uint64_t begin = now_ns();
+    int result = pthread_rwlock_wrlock(l);
+    if (result == 0) acquired(cls, l, 1, now_ns() - begin, file, line);
+    return result;
+}
+
+int lockprof_rwlock_unlock(pthread_rwlock_t *l) {
+    released(l);
+    return pthread_rwlock_unlock(l);
+}
+
+// Prints the lower bound of a log2 bucket with a readable unit
+static void print_bucket(FILE *f, int bucket) {
+    uint64_t ns = bucket ? 1ULL << (bucket - 1) : 0;
+    if (ns < 1000) fprintf(f, "%8lluns", (unsigned long long)ns);
+    else if (ns < 1000000) fprintf(f, "%8lluus", (unsigned long long)(ns / 1000));
+    else if (ns < 1000000000) fprintf(f, "%8llums", (unsigned long long)(ns / 1000000));
+    else fprintf(f, "%8llus ", (unsigned long long)(ns / 1000000000));
+}
+
+static void print_histogram(FILE *f, const char *title, _Atomic uint64_t *histogram) {
+    fprintf(f, "  %s:\n", title);
+    for (int b = 0; b < HISTOGRAM_BUCKETS; b++) {
+        uint64_t count = atomic_load_explicit(&histogram[b], memory_order_relaxed);
+        if (count == 0) continue;
+        fprintf(f, "    >=");
+        print_bucket(f, b);
+        fprintf(f, " %llu\n", (unsigned long long)count);
+    }
+}
+
+int lockprof_dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+
+    uint64_t start = atomic_load(&start_ns);
+    double elapsed = start ? (now_ns() - start) / 1e9 : 0.0;
+    fprintf(f, "Lock profile (%.1fs since the first acquisition)\n================================\n\n", elapsed);
+    fprintf(f, "%-8s %14s %12s %14s %12s %14s %12s\n", "class", "acquisitions", "contended",
+            "wait_total_us", "wait_max_us", "hold_total_us", "hold_max_us");
+    for (int c = 0; c < LOCK_CLASS_COUNT; c++) {
+        lock_stats_t *s = &stats[c];
+        fprintf(f, "%-8s %14llu %12llu %14llu %12llu %14llu %12llu\n", class_names[c],
+                (unsigned long long)atomic_load(&s->acquisitions), (unsigned long long)atomic_load(&s->contended),
+                (unsigned long long)(atomic_load(&s->wait_ns) / 1000), (unsigned long long)(atomic_load(&s->max_wait_ns) / 1000),
+                (unsigned long long)(atomic_load(&s->hold_ns) / 1000), (unsigned long long)(atomic_load(&s->max_hold_ns) / 1000));
+    }
+
+    for (int c = 0; c < LOCK_CLASS_COUNT; c++) {
+        if (atomic_load(&stats[c].acquisitions) == 0) continue;
+        fprintf(f, "\n%s locks\n", class_names[c]);
+        print_histogram(f, "wait", stats[c].wait_histogram);
+        print_histogram(f, "hold", stats[c].hold_histogram);
+    }
+
+    // Selection of the most contended call sites (the table is small)
+    int taken[MAX_CALL_SITES] = {0};
+    fprintf(f, "\nMost contended call sites\n");
+    int printed = 0;
+    for (int rank = 0; rank < TOP_CALL_SITES; rank++) {
+        int best = -1;
+        uint64_t best_count = 0;
+        for (int i = 0; i < MAX_CALL_SITES; i++) {
+            uint64_t count = atomic_load(&call_sites[i].contended);
+            if (!taken[i] && atomic_load(&call_sites[i].key) != 0 && count > best_count) {
+                best = i;
+                best_count = count;
+            }
+        }
+        if (best == -1) break;
+        taken[best] = 1;
+        uint64_t key = atomic_load(&call_sites[best].key);
+        const char *file = (const char*)(uintptr_t)(key & 0xFFFFFFFFFFFFULL);
+        fprintf(f, "  %s:%d (%s) blocked %llu times, %llu us\n", file, (int)(key >> 48),
+                class_names[atomic_load(&call_sites[best].cls)], (unsigned long long)best_count,
+                (unsigned long long)(atomic_load(&call_sites[best].wait_ns) / 1000));
+        printed++;
+    }
+    if (printed == 0) fprintf(f, "  none\n");
+    if (atomic_load(&dropped_sites)) {
+        fprintf(f, "  (%llu contended acquisitions from untracked sites)\n", (unsigned long long)atomic_load(&dropped_sites));
+    }
+
+    fclose(f);
+    return 0;
+}
+
+#else
+
+int lockprof_dump(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (!f) return -1;
+    fprintf(f, "Lock profiling is not compiled in (build with make LOCK_PROFILING=1)\n");
+    fclose(f);
+    return 0;
+}
+
+#endif
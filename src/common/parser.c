@@ -6,7 +6,39 @@
 #include "board.h"
 #include <fcntl.h>
 
-int read_level(board_t* board, char* filename, char* dirname) {
+// Commands accepted in the moves section of each kind of file ('T n' is always accepted)
+#define GHOST_COMMANDS "ADWSRC"
+#define PACMAN_COMMANDS "ADWSRGQ"
+
+// Parses the moves section that ends a pacman/ghost file. command holds the
+// first line of the section. Returns the last read_line result (-1 on error)
+static int read_moves(int fd, char *command, int read, command_t *moves, int *n_moves, const char *accepted) {
+    int move = 0;
+    while (read > 0 && move < MAX_MOVES) {
+        if (command[0] == '#' || command[0] == '\0') {
+            read = read_line(fd, command);
+            continue;
+        }
+        if (command[0] != 'T' && strchr(accepted, command[0])) {
+            moves[move].command = command[0];
+            moves[move].turns = 1;
+            move += 1;
+        }
+        else if (command[0] == 'T' && command[1] == ' ') {
+            int t = atoi(command+2);
+            if (t > 0) {
+                moves[move].command = command[0];
+                moves[move].turns = t;
+                move += 1;
+            }
+        }
+        read = read_line(fd, command);
+    }
+    *n_moves = move;
+    return read;
+}
+
+int read_level(level_t* level, char* filename, char* dirname) {
 
     char fullname[MAX_FILENAME];
     strcpy(fullname, dirname);
@@ -22,11 +54,11 @@ int read_level(board_t* board, char* filename, char* dirname) {
     char command[MAX_COMMAND_LENGTH];
 
     // Pacman is optional
-    board->pacman_file[0] = '\0';
-    board->n_pacmans = 1;
+    level->pacman_file[0] = '\0';
+    level->n_pacmans = 1;
 
-    strcpy(board->level_name, filename);
-    *strrchr(board->level_name, '.') = '\0';
+    strcpy(level->name, filename);
+    *strrchr(level->name, '.') = '\0';
 
     int read;
     while ((read = read_line(fd, command)) > 0) {
@@ -34,45 +66,46 @@ int read_level(board_t* board, char* filename, char* dirname) {
         // comment
         if (command[0] == '#' || command[0] == '\0') continue;
 
-        char *word = strtok(command, " \t\n");
+        char *save;
+        char *word = strtok_r(command, " \t\n", &save);
         if (!word) continue;  // skip empty line
 
         if (strcmp(word, "DIM") == 0) {
-            char *arg1 = strtok(NULL, " \t\n");
-            char *arg2 = strtok(NULL, " \t\n");
+            char *arg1 = strtok_r(NULL, " \t\n", &save);
+            char *arg2 = strtok_r(NULL, " \t\n", &save);
             if (arg1 && arg2) {
-                board->width = atoi(arg1);
-                board->height = atoi(arg2);
-                debug("DIM = %d x %d\n", board->width, board->height);
+                level->width = atoi(arg1);
+                level->height = atoi(arg2);
+                debug("DIM = %d x %d\n", level->width, level->height);
             }
         }
 
         else if (strcmp(word, "TEMPO") == 0) {
-            char *arg = strtok(NULL, " \t\n");
+            char *arg = strtok_r(NULL, " \t\n", &save);
             if (arg) {
-                board->tempo = atoi(arg);
-                debug("TEMPO = %d\n", board->tempo);
+                level->tempo = atoi(arg);
+                debug("TEMPO = %d\n", level->tempo);
             }
         }
 
         else if (strcmp(word, "PAC") == 0) {
-            char *arg = strtok(NULL, " \t\n");
+            char *arg = strtok_r(NULL, " \t\n", &save);
             if (arg) {
-                snprintf(board->pacman_file, sizeof(board->pacman_file), "%s/%s", dirname, arg);
-                debug("PAC = %s\n", board->pacman_file);
+                snprintf(level->pacman_file, sizeof(level->pacman_file), "%s/%s", dirname, arg);
+                debug("PAC = %s\n", level->pacman_file);
             }
         }
 
         else if (strcmp(word, "MON") == 0) {
             char *arg;
             int i = 0;
-            while ((arg = strtok(NULL, " \t\n")) != NULL) {
-                snprintf(board->ghosts_files[i], sizeof(board->ghosts_files[0]), "%s/%s", dirname, arg);
-                debug("MON file: %s\n", board->ghosts_files[i]);
+            while ((arg = strtok_r(NULL, " \t\n", &save)) != NULL) {
+                snprintf(level->ghosts_files[i], sizeof(level->ghosts_files[0]), "%s/%s", dirname, arg);
+                debug("MON file: %s\n", level->ghosts_files[i]);
                 i+= 1;
                 if (i == MAX_GHOSTS-1) break;
             }
-            board->n_ghosts = i;
+            level->n_ghosts = i;
         }
 
         else {
@@ -80,40 +113,43 @@ int read_level(board_t* board, char* filename, char* dirname) {
         }
     }
 
-    if (!board->width || !board->height) {
+    if (!level->width || !level->height) {
         debug("Missing dimensions in level file\n");
         close(fd);
         return -1;
     }
     
     // the end of the file contains the grid
-    board->board = calloc(board->width * board->height, sizeof(board_pos_t));
-    board->pacmans = calloc(board->n_pacmans, sizeof(pacman_t));
-    board->ghosts = calloc(board->n_ghosts, sizeof(ghost_t));
+    level->grid = calloc(level->width * level->height, sizeof(char));
+    level->pacmans = calloc(level->n_pacmans, sizeof(pacman_t));
+    level->ghosts = calloc(level->n_ghosts > 0 ? level->n_ghosts : 1, sizeof(ghost_t));
+    level->ghost_scripts = calloc(level->n_ghosts > 0 ? level->n_ghosts : 1, sizeof(*level->ghost_scripts));
+    if (!level->grid || !level->pacmans || !level->ghosts || !level->ghost_scripts) {
+        close(fd);
+        return -1;
+    }
 
     int row = 0;
     // command here still holds the previous line
     while (read > 0) {
         if (command[0]== '#' || command[0] == '\0') continue;
-        if (row >= board->height) break;
+        if (row >= level->height) break;
 
         debug("Line: %s\n", command);
 
-        for (int col = 0; col < board -> width; col++){
-            int idx = row * board->width + col;
+        for (int col = 0; col < level->width; col++){
+            int idx = row * level->width + col;
             char content = command[col];
 
             switch (content) {
                 case 'X': // wall
-                    board->board[idx].content = 'W';
+                    level->grid[idx] = 'W';
                     break;
                 case '@': // portal
-                    board->board[idx].content = ' ';
-                    board->board[idx].has_portal = 1;
+                    level->grid[idx] = '@';
                     break;
                 default:
-                    board->board[idx].content = ' ';
-                    board->board[idx].has_dot = 1;
+                    level->grid[idx] = '.';
                     break;
             }
         }
@@ -132,34 +168,31 @@ int read_level(board_t* board, char* filename, char* dirname) {
     return 0;
 }
 
-int read_pacman(board_t* board, int points) {
-    pacman_t* pacman = &board->pacmans[0];
+int read_pacman(level_t* level) {
+    pacman_t* pacman = &level->pacmans[0];
     pacman->alive = 1;
-    pacman->points = points;
+    level->pacman_script_len = 0;
 
     // no file was provided -> defaults 
-    if (board->pacman_file[0] == '\0') {
+    if (level->pacman_file[0] == '\0') {
         pacman->passo = 0;
         pacman->waiting = 0;
-        pacman->n_moves = 0; // user controlled
-        // default position -> find first non occupied cell
-        for (int i = 0; i < board->height; i++) {
-            for (int j = 0; j < board->width; j++) {
-                int idx = i * board->width + j;
-                if (board->board[idx].content == ' ') {
-                    pacman->pos_x = j;
-                    pacman->pos_y = i;
-                    board->board[idx].content = 'P';
-                    goto pacman_inserted;
-                }
+        // default position -> first cell that is not a wall
+        for (int idx = 0; idx < level->width * level->height; idx++) {
+            if (level->grid[idx] != 'W') {
+                pacman->pos_x = idx % level->width;
+                pacman->pos_y = idx / level->width;
+                break;
             }
         }
-
-        pacman_inserted:
         return 0;
     }
 
-    int fd = open(board->pacman_file, O_RDONLY);
+    int fd = open(level->pacman_file, O_RDONLY);
+    if (fd == -1) {
+        debug("Error opening file %s\n", level->pacman_file);
+        return -1;
+    }
 
     int read;
     char command[MAX_COMMAND_LENGTH];
@@ -167,11 +200,12 @@ int read_pacman(board_t* board, int points) {
         // comment
         if (command[0] == '#' || command[0] == '\0') continue;
 
-        char *word = strtok(command, " \t\n");
+        char *save;
+        char *word = strtok_r(command, " \t\n", &save);
         if (!word) continue;  // skip empty line
 
         if (strcmp(word, "PASSO") == 0) {
-            char *arg = strtok(NULL, " \t\n");
+            char *arg = strtok_r(NULL, " \t\n", &save);
             if (arg) {
                 pacman->passo = atoi(arg);
                 pacman->waiting = pacman->passo;
@@ -179,13 +213,11 @@ int read_pacman(board_t* board, int points) {
             }
         }
         else if (strcmp(word, "POS") == 0) {
-            char *arg1 = strtok(NULL, " \t\n");
-            char *arg2 = strtok(NULL, " \t\n");
+            char *arg1 = strtok_r(NULL, " \t\n", &save);
+            char *arg2 = strtok_r(NULL, " \t\n", &save);
             if (arg1 && arg2) {
                 pacman->pos_x = atoi(arg1);
                 pacman->pos_y = atoi(arg2);
-                int idx = pacman->pos_y * board->width + pacman->pos_x;
-                board->board[idx].content = 'P';
                 debug("Pacman Pos = %d x %d\n", pacman->pos_x, pacman->pos_y);
             }
         }
@@ -195,20 +227,32 @@ int read_pacman(board_t* board, int points) {
     }
 
     // Segundo enunciado parte 2: ficheiro .p serve apenas para configuração (POS e PASSO)
-    // Os comandos vêm exclusivamente via named pipe do cliente
-    // Ignorar quaisquer comandos que possam existir no ficheiro
-    pacman->current_move = 0;
-    pacman->n_moves = 0;  // Modo controlado pelo cliente (sem movimentos automáticos)
+    // Os comandos vêm exclusivamente via named pipe do cliente, por isso ficam
+    // guardados à parte e só os usa quem chamar read_pacman_moves
+    read = read_moves(fd, command, read, level->pacman_script, &level->pacman_script_len, PACMAN_COMMANDS);
 
     close(fd);
-    return 0;
+    return read == -1 ? -1 : 0;
 }
 
 
-int read_ghosts(board_t* board) {
-    for (int i = 0; i < board->n_ghosts; i++) {
-        int fd = open(board->ghosts_files[i], O_RDONLY);
-        ghost_t* ghost = &board->ghosts[i];
+int read_pacman_moves(board_t* board) {
+    pacman_t* pacman = &board->pacmans[0];
+    pacman->current_move = 0;
+    pacman->turns_left = 0;
+    pacman->moves = board->level->pacman_script;
+    pacman->n_moves = board->level->pacman_script_len;
+    return 0;
+}
+
+int read_ghosts(level_t* level) {
+    for (int i = 0; i < level->n_ghosts; i++) {
+        int fd = open(level->ghosts_files[i], O_RDONLY);
+        if (fd == -1) {
+            debug("Error opening file %s\n", level->ghosts_files[i]);
+            return -1;
+        }
+        ghost_t* ghost = &level->ghosts[i];
 
         int read;
         char command[MAX_COMMAND_LENGTH];
@@ -216,11 +260,12 @@ int read_ghosts(board_t* board) {
             // comment
             if (command[0] == '#' || command[0] == '\0') continue;
 
-            char *word = strtok(command, " \t\n");
+            char *save;
+            char *word = strtok_r(command, " \t\n", &save);
             if (!word) continue;  // skip empty line
 
             if (strcmp(word, "PASSO") == 0) {
-                char *arg = strtok(NULL, " \t\n");
+                char *arg = strtok_r(NULL, " \t\n", &save);
                 if (arg) {
                     ghost->passo = atoi(arg);
                     ghost->waiting = ghost->passo;
@@ -228,13 +273,11 @@ int read_ghosts(board_t* board) {
                 }
             }
             else if (strcmp(word, "POS") == 0) {
-                char *arg1 = strtok(NULL, " \t\n");
-                char *arg2 = strtok(NULL, " \t\n");
+                char *arg1 = strtok_r(NULL, " \t\n", &save);
+                char *arg2 = strtok_r(NULL, " \t\n", &save);
                 if (arg1 && arg2) {
                     ghost->pos_x = atoi(arg1);
                     ghost->pos_y = atoi(arg2);
-                    int idx = ghost->pos_y * board->width + ghost->pos_x;
-                    board->board[idx].content = 'M';
                     debug("Ghost Pos = %d x %d\n", ghost->pos_x, ghost->pos_y);
                 }
             }
@@ -245,33 +288,10 @@ int read_ghosts(board_t* board) {
 
         // end of the file contains the moves
         ghost->current_move = 0;
+        ghost->moves = level->ghost_scripts[i];
 
         // command here still holds the previous line
-        int move = 0;
-        while (read > 0 && move < MAX_MOVES) {
-            if (command[0]== '#' || command[0] == '\0') continue;
-            if (command[0] == 'A' ||
-                command[0] == 'D' ||
-                command[0] == 'W' ||
-                command[0] == 'S' ||
-                command[0] == 'R' ||
-                command[0] == 'C') {
-                    ghost->moves[move].command = command[0];
-                    ghost->moves[move].turns = 1; 
-                    move += 1;
-            }
-            else if (command[0] == 'T' && command[1] == ' ') {
-                int t = atoi(command+2);
-                if (t > 0) {
-                    ghost->moves[move].command = command[0];
-                    ghost->moves[move].turns = t;
-                    ghost->moves[move].turns_left = t;
-                    move += 1;
-                }
-            }
-            read = read_line(fd, command);
-        }
-        ghost->n_moves = move;
+        read = read_moves(fd, command, read, level->ghost_scripts[i], &ghost->n_moves, GHOST_COMMANDS);
 
         if (read == -1) {
             debug("Failed reading line\n");
@@ -0,0 +1,181 @@
+#include "simulation.h"
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+int save_ring_reset(save_ring_t *ring, board_t *board) {
+    ring->head = 0;
+    ring->count = 0;
+
+    int cells = board->width * board->height;
+    for (int i = 0; i < MAX_SAVES; i++) {
+        save_t *slot = &ring->slots[i];
+        if (cells > ring->cells_capacity) {
+            saved_cell_t *grown = realloc(slot->cells, cells * sizeof(saved_cell_t));
+            if (!grown) return -1;
+            slot->cells = grown;
+        }
+        if (board->n_pacmans > ring->pacmans_capacity) {
+            pacman_t *grown = realloc(slot->pacmans, board->n_pacmans * sizeof(pacman_t));
+            if (!grown) return -1;
+            slot->pacmans = grown;
+        }
+        if (board->n_ghosts > ring->ghosts_capacity) {
+            ghost_t *grown = realloc(slot->ghosts, board->n_ghosts * sizeof(ghost_t));
+            if (!grown) return -1;
+            slot->ghosts = grown;
+        }
+    }
+    if (cells > ring->cells_capacity) ring->cells_capacity = cells;
+    if (board->n_pacmans > ring->pacmans_capacity) ring->pacmans_capacity = board->n_pacmans;
+    if (board->n_ghosts > ring->ghosts_capacity) ring->ghosts_capacity = board->n_ghosts;
+    return 0;
+}
+
+void save_ring_free(save_ring_t *ring) {
+    for (int i = 0; i < MAX_SAVES; i++) {
+        free(ring->slots[i].cells);
+        free(ring->slots[i].pacmans);
+        free(ring->slots[i].ghosts);
+    }
+    memset(ring, 0, sizeof(*ring));
+}
+
+void save_push(save_ring_t *ring, board_t *board) {
+    save_t *slot = &ring->slots[ring->head];
+    for (int i = 0; i < board->width * board->height; i++) {
+        slot->cells[i].content = board->board[i].content;
+        slot->cells[i].has_dot = (char)board->board[i].has_dot;
+        slot->cells[i].has_portal = (char)board->board[i].has_portal;
+    }
+    memcpy(slot->pacmans, board->pacmans, board->n_pacmans * sizeof(pacman_t));
+    memcpy(slot->ghosts, board->ghosts, board->n_ghosts * sizeof(ghost_t));
+    slot->rng_state = atomic_load_explicit(&board->rng_state, memory_order_relaxed);
+
+    ring->head = (ring->head + 1) % MAX_SAVES;
+    if (ring->count < MAX_SAVES) ring->count++;
+}
+
+int save_pop(save_ring_t *ring, board_t *board) {
+    if (ring->count == 0) return -1;
+
+    ring->head = (ring->head + MAX_SAVES - 1) % MAX_SAVES;
+    ring->count--;
+
+    save_t *slot = &ring->slots[ring->head];
+    for (int i = 0; i < board->width * board->height; i++) {
+        board->board[i].content = slot->cells[i].content;
+        board->board[i].has_dot = slot->cells[i].has_dot;
+        board->board[i].has_portal = slot->cells[i].has_portal;
+    }
+    memcpy(board->pacmans, slot->pacmans, board->n_pacmans * sizeof(pacman_t));
+    memcpy(board->ghosts, slot->ghosts, board->n_ghosts * sizeof(ghost_t));
+    atomic_store_explicit(&board->rng_state, slot->rng_state, memory_order_relaxed);
+    return 0;
+}
+
+int simulation_tick(board_t *board, char key) {
+    pacman_t *pacman = &board->pacmans[0];
+    if (!pacman->alive) return LOAD_BACKUP;
+
+    command_t c;
+    const command_t *play = NULL;
+    if (pacman->n_moves > 0) {
+        play = &pacman->moves[pacman->current_move % pacman->n_moves];
+    } else if (key != '\0') {
+        c.command = key;
+        c.turns = 1;
+        play = &c;
+    }
+
+    if (play && play->command == 'Q') return QUIT_GAME;
+    if (play && play->command == 'G') {
+        // A scripted save must not be replayed forever once resumed
+        if (pacman->n_moves > 0) pacman->current_move++;
+        return CREATE_BACKUP;
+    }
+
+    int result = board_step(board, play);
+    if (result == REACHED_PORTAL) return NEXT_LEVEL;
+    if (result == DEAD_PACMAN) return LOAD_BACKUP;
+    return CONTINUE_PLAY;
+}
+
+int simulation_step(board_t *board, save_ring_t *saves) {
+    int result = simulation_tick(board, '\0');
+    if (result == CREATE_BACKUP) {
+        save_push(saves, board);
+        return CONTINUE_PLAY;
+    }
+    if (result == LOAD_BACKUP && save_pop(saves, board) == 0) return CONTINUE_PLAY;
+    return result;
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(char* const*) a, *(char* const*) b);
+}
+
+int list_level_files(const char *dirname, char ***levels) {
+    DIR* level_dir = opendir(dirname);
+    if (level_dir == NULL) return -1;
+
+    char **found = NULL;
+    int n_levels = 0, capacity = 0;
+    struct dirent* entry;
+    while ((entry = readdir(level_dir)) != NULL) {
+        char *dot = strrchr(entry->d_name, '.');
+        if (entry->d_name[0] == '.' || !dot || strcmp(dot, ".lvl") != 0) continue;
+        if (n_levels == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            char **grown = realloc(found, capacity * sizeof(char*));
+            if (!grown) break;
+            found = grown;
+        }
+        char *name = strdup(entry->d_name);
+        if (!name) break;
+        found[n_levels++] = name;
+    }
+    closedir(level_dir);
+    if (n_levels > 1) qsort(found, n_levels, sizeof(char*), compare_names);
+    *levels = found;
+    return n_levels;
+}
+
+void free_level_files(char **levels, int n_levels) {
+    for (int i = 0; i < n_levels; i++) free(levels[i]);
+    free(levels);
+}
+
+typedef struct {
+    void (*job)(void *ctx, int index);
+    void *ctx;
+    int n_jobs;
+    _Atomic int next;       // Next job to hand out
+} job_pool_t;
+
+static void* job_worker(void *arg) {
+    job_pool_t *pool = (job_pool_t*) arg;
+    for (;;) {
+        int index = atomic_fetch_add(&pool->next, 1);
+        if (index >= pool->n_jobs) break;
+        pool->job(pool->ctx, index);
+    }
+    return NULL;
+}
+
+void run_jobs(int n_jobs, int n_workers, void (*job)(void *ctx, int index), void *ctx) {
+    job_pool_t pool = { .job = job, .ctx = ctx, .n_jobs = n_jobs, .next = 0 };
+    if (n_workers > n_jobs) n_workers = n_jobs;
+    pthread_t *workers = malloc((n_workers > 0 ? n_workers : 1) * sizeof(pthread_t));
+    int started = 0;
+    for (int i = 0; workers && i < n_workers; i++) {
+        if (pthread_create(&workers[i], NULL, job_worker, &pool) != 0) break;
+        started++;
+    }
+    // Without threads the caller does the work itself
+    if (started == 0) job_worker(&pool);
+    for (int i = 0; i < started; i++) pthread_join(workers[i], NULL);
+    free(workers);
+}
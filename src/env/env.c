@@ -0,0 +1,270 @@
+#include "env.h"
+#include "board.h"
+#include <stdlib.h>
+#include <pthread.h>
+
+typedef enum {
+    ENV_JOB_STEP,
+    ENV_JOB_RESET,
+} env_job_t;
+
+typedef struct {
+    board_t board;
+    int steps;   // Steps of the current episode
+} env_slot_t;
+
+typedef struct {
+    pacman_env_t *env;
+    int part;
+} env_worker_arg_t;
+
+struct pacman_env {
+    level_t *level;         // Static level data shared by every clone, resets copy its starting state
+    env_slot_t *slots;
+    int n_envs;
+    int cells;
+    int max_steps;
+
+    // Worker pool: the caller publishes a job by bumping generation and
+    // works on partition 0 itself, worker i takes partition i + 1
+    pthread_t *workers;
+    env_worker_arg_t *worker_args;
+    int n_workers;
+    pthread_mutex_t lock;
+    pthread_cond_t work_ready;
+    pthread_cond_t work_done;
+    unsigned long generation;
+    int pending;            // Workers still running the current job
+    int shutdown;
+
+    // Current job, written under lock before the generation is bumped
+    env_job_t job;
+    const char *actions;
+    char *observations;
+    int *rewards;
+    int *statuses;
+};
+
+// Characters of the frames sent to the clients, plus 'G' for a charged ghost (the server sends 'M')
+static void observe(board_t *board, char *out) {
+    int cells = board->width * board->height;
+    for (int i = 0; i < cells; i++) {
+        board_pos_t *cell = &board->board[i];
+        switch (cell->content) {
+            case 'W': out[i] = '#'; break;
+            case 'P': out[i] = 'C'; break;
+            case 'M': out[i] = 'M'; break;
+            default:
+                if (cell->has_portal) out[i] = '@';
+                else if (cell->has_dot) out[i] = '.';
+                else out[i] = ' ';
+                break;
+        }
+    }
+    for (int g = 0; g < board->n_ghosts; g++) {
+        ghost_t *ghost = &board->ghosts[g];
+        int idx = ghost->pos_y * board->width + ghost->pos_x;
+        if (ghost->charged && out[idx] == 'M') out[idx] = 'G';
+    }
+}
+
+// Puts a clone back in the level's starting state (its rng keeps going)
+static void restore_board(env_slot_t *slot) {
+    board_reset(&slot->board, 0);
+    slot->steps = 0;
+}
+
+static void step_one(pacman_env_t *env, int i) {
+    env_slot_t *slot = &env->slots[i];
+    board_t *board = &slot->board;
+    int points_before = board->pacmans[0].points;
+
+    command_t cmd = { .command = env->actions ? env->actions[i] : '\0', .turns = 1 };
+    int result = board_step(board, cmd.command != '\0' ? &cmd : NULL);
+    slot->steps++;
+
+    int status = ENV_RUNNING;
+    if (result == REACHED_PORTAL) status = ENV_WON;
+    else if (result == DEAD_PACMAN) status = ENV_DIED;
+    else if (env->max_steps > 0 && slot->steps >= env->max_steps) status = ENV_TRUNCATED;
+
+    if (env->rewards) env->rewards[i] = board->pacmans[0].points - points_before;
+    if (env->statuses) env->statuses[i] = status;
+
+    // Auto-reset: the caller gets the first frame of the next episode
+    if (status != ENV_RUNNING) restore_board(slot);
+    if (env->observations) observe(board, env->observations + (size_t)i * env->cells);
+}
+
+static void reset_one(pacman_env_t *env, int i) {
+    restore_board(&env->slots[i]);
+    if (env->observations) observe(&env->slots[i].board, env->observations + (size_t)i * env->cells);
+}
+
+static void run_partition(pacman_env_t *env, int part) {
+    int parts = env->n_workers + 1;
+    int start = (int)((long)env->n_envs * part / parts);
+    int end = (int)((long)env->n_envs * (part + 1) / parts);
+    for (int i = start; i < end; i++) {
+        if (env->job == ENV_JOB_STEP) step_one(env, i);
+        else reset_one(env, i);
+    }
+}
+
+static void* env_worker(void *arg) {
+    env_worker_arg_t *worker = (env_worker_arg_t*) arg;
+    pacman_env_t *env = worker->env;
+    unsigned long seen = 0;
+
+    pthread_mutex_lock(&env->lock);
+    while (1) {
+        while (!env->shutdown && env->generation == seen) {
+            pthread_cond_wait(&env->work_ready, &env->lock);
+        }
+        if (env->shutdown) break;
+        seen = env->generation;
+        pthread_mutex_unlock(&env->lock);
+
+        run_partition(env, worker->part);
+
+        pthread_mutex_lock(&env->lock);
+        if (--env->pending == 0) pthread_cond_signal(&env->work_done);
+    }
+    pthread_mutex_unlock(&env->lock);
+    return NULL;
+}
+
+static void run_job(pacman_env_t *env, env_job_t job, const char *actions, char *observations,
+                    int *rewards, int *statuses) {
+    pthread_mutex_lock(&env->lock);
+    env->job = job;
+    env->actions = actions;
+    env->observations = observations;
+    env->rewards = rewards;
+    env->statuses = statuses;
+    env->pending = env->n_workers;
+    env->generation++;
+    pthread_cond_broadcast(&env->work_ready);
+    pthread_mutex_unlock(&env->lock);
+
+    run_partition(env, 0);
+
+    pthread_mutex_lock(&env->lock);
+    while (env->pending > 0) {
+        pthread_cond_wait(&env->work_done, &env->lock);
+    }
+    pthread_mutex_unlock(&env->lock);
+}
+
+// Gives a clone its own cells and entities, in the level's starting state
+static int clone_board(pacman_env_t *env, env_slot_t *slot, uint64_t seed) {
+    if (board_init(&slot->board, env->level, 0) != 0) return -1;
+    seed_board_rng(&slot->board, seed);
+    slot->steps = 0;
+    return 0;
+}
+
+pacman_env_t *env_create(char *level_dir, char *level_file, int n_envs, int n_threads,
+                         int max_steps, uint64_t seed) {
+    if (n_envs <= 0) return NULL;
+    if (n_threads < 1) n_threads = 1;
+    if (n_threads > n_envs) n_threads = n_envs;
+
+    pacman_env_t *env = calloc(1, sizeof(pacman_env_t));
+    if (!env) return NULL;
+
+    env->level = level_load(level_file, level_dir);
+    if (!env->level) {
+        free(env);
+        return NULL;
+    }
+    env->cells = env->level->width * env->level->height;
+    env->max_steps = max_steps;
+
+    env->slots = calloc(n_envs, sizeof(env_slot_t));
+    if (!env->slots) {
+        level_release(env->level);
+        free(env);
+        return NULL;
+    }
+    for (int i = 0; i < n_envs; i++) {
+        if (clone_board(env, &env->slots[i], seed + (uint64_t)i) != 0) {
+            env_destroy(env);
+            return NULL;
+        }
+        env->n_envs = i + 1;
+    }
+
+    pthread_mutex_init(&env->lock, NULL);
+    pthread_cond_init(&env->work_ready, NULL);
+    pthread_cond_init(&env->work_done, NULL);
+
+    env->workers = calloc(n_threads, sizeof(pthread_t));
+    env->worker_args = calloc(n_threads, sizeof(env_worker_arg_t));
+    if (!env->workers || !env->worker_args) {
+        // env_destroy only tears the pool down when it exists
+        free(env->workers);
+        free(env->worker_args);
+        env->workers = NULL;
+        env->worker_args = NULL;
+        pthread_cond_destroy(&env->work_ready);
+        pthread_cond_destroy(&env->work_done);
+        pthread_mutex_destroy(&env->lock);
+        env_destroy(env);
+        return NULL;
+    }
+    for (int i = 0; i < n_threads - 1; i++) {
+        env->worker_args[i].env = env;
+        env->worker_args[i].part = i + 1;
+        if (pthread_create(&env->workers[i], NULL, env_worker, &env->worker_args[i]) != 0) break;
+        env->n_workers++;
+    }
+    return env;
+}
+
+void env_destroy(pacman_env_t *env) {
+    if (!env) return;
+
+    if (env->workers) {
+        pthread_mutex_lock(&env->lock);
+        env->shutdown = 1;
+        pthread_cond_broadcast(&env->work_ready);
+        pthread_mutex_unlock(&env->lock);
+        for (int i = 0; i < env->n_workers; i++) {
+            pthread_join(env->workers[i], NULL);
+        }
+        pthread_cond_destroy(&env->work_ready);
+        pthread_cond_destroy(&env->work_done);
+        pthread_mutex_destroy(&env->lock);
+    }
+    free(env->workers);
+    free(env->worker_args);
+
+    // Clones only share the level, each holds a reference to it
+    for (int i = 0; i < env->n_envs; i++) {
+        unload_level(&env->slots[i].board);
+    }
+    free(env->slots);
+    level_release(env->level);
+    free(env);
+}
+
+int env_observation_size(const pacman_env_t *env) {
+    return env->cells;
+}
+
+int env_width(const pacman_env_t *env) {
+    return env->level->width;
+}
+
+int env_height(const pacman_env_t *env) {
+    return env->level->height;
+}
+
+void env_reset(pacman_env_t *env, char *observations) {
+    run_job(env, ENV_JOB_RESET, NULL, observations, NULL, NULL);
+}
+
+void env_step(pacman_env_t *env, const char *actions, char *observations, int *rewards, int *statuses) {
+    run_job(env, ENV_JOB_STEP, actions, observations, rewards, statuses);
+}
@@ -0,0 +1,108 @@
+#include "actor.h"
+#include "executor.h"
+#include "ticker.h"
+#include "coro.h"
+#include <sched.h>
+#include <time.h>
+#include <stdatomic.h>
+
+void actor_start(session_t *sess) {
+    atomic_store(&sess->mailbox.head, 0);
+    atomic_store(&sess->mailbox.tail, 0);
+    ticker_arm(sess);
+    atomic_store_explicit(&sess->actor_state, ACTOR_IDLE, memory_order_release);
+    ticker_schedule(sess);
+}
+
+void actor_stop(session_t *sess) {
+    for (;;) {
+        int state = atomic_load(&sess->actor_state);
+        if (state == ACTOR_OFF) return;
+        if (state == ACTOR_IDLE) {
+            if (atomic_compare_exchange_strong(&sess->actor_state, &state, ACTOR_OFF)) {
+                ticker_unschedule(sess);
+                return;
+            }
+            continue;
+        }
+        // A step or a checkpoint holds it: yield until it is released
+        if (coro_sleep_ms(1) != 0) sched_yield();
+    }
+}
+
+int actor_post(session_t *sess, const mail_t *mail) {
+    mailbox_t *box = &sess->mailbox;
+    unsigned tail = atomic_load_explicit(&box->tail, memory_order_relaxed);
+    unsigned head = atomic_load_explicit(&box->head, memory_order_acquire);
+    if (tail - head == MAILBOX_SIZE) return -1;
+    box->slots[tail & (MAILBOX_SIZE - 1)] = *mail;
+    atomic_store_explicit(&box->tail, tail + 1, memory_order_release);
+    return 0;
+}
+
+int actor_take(session_t *sess, mail_t *mail) {
+    mailbox_t *box = &sess->mailbox;
+    unsigned head = atomic_load_explicit(&box->head, memory_order_relaxed);
+    unsigned tail = atomic_load_explicit(&box->tail, memory_order_acquire);
+    if (head == tail) return 0;
+    *mail = box->slots[head & (MAILBOX_SIZE - 1)];
+    atomic_store_explicit(&box->head, head + 1, memory_order_release);
+    return 1;
+}
+
+static int has_mail(session_t *sess) {
+    return atomic_load_explicit(&sess->mailbox.head, memory_order_acquire) !=
+           atomic_load_explicit(&sess->mailbox.tail, memory_order_acquire);
+}
+
+int actor_claim(session_t *sess) {
+    int expected = ACTOR_IDLE;
+    return atomic_compare_exchange_strong(&sess->actor_state, &expected, ACTOR_RUNNING);
+}
+
+static void actor_task(void *arg) {
+    actor_run(arg);
+}
+
+void actor_notify(session_t *sess) {
+    if (has_mail(sess) && actor_claim(sess)) executor_submit(actor_task, sess);
+}
+
+void actor_run(session_t *sess) {
+    session_actor_step(sess);
+    atomic_store_explicit(&sess->actor_state, ACTOR_IDLE, memory_order_release);
+    // The step moved the deadline (or ended the game, which unqueues it)
+    ticker_schedule(sess);
+    // Mail posted while the step ran found the actor busy: schedule it now
+    actor_notify(sess);
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int actor_park(session_t *sess, int timeout_ms) {
+    uint64_t deadline = 0;
+    for (;;) {
+        int state = atomic_load(&sess->actor_state);
+        if (state == ACTOR_OFF) return 0;
+        if (state == ACTOR_IDLE) {
+            if (atomic_compare_exchange_strong(&sess->actor_state, &state, ACTOR_PARKED)) return 1;
+            continue;
+        }
+        // Steps never wait for clients, only a stuck one outlasts the timeout
+        uint64_t now = now_ns();
+        if (deadline == 0) deadline = now + (uint64_t)timeout_ms * 1000000ULL;
+        if (now >= deadline) return -1;
+        sched_yield();
+    }
+}
+
+void actor_unpark(session_t *sess) {
+    atomic_store_explicit(&sess->actor_state, ACTOR_IDLE, memory_order_release);
+    // The ticker may have found it parked and dropped it, and a catch-up moved the deadline
+    ticker_schedule(sess);
+    actor_notify(sess);
+}
@@ -0,0 +1,257 @@
+#include "checkpoint.h"
+#include "server.h"
+#include "board.h"
+#include "actor.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <stdatomic.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+int checkpoint_interval_ms = 0;
+char checkpoint_file[256] = DEFAULT_CHECKPOINT_FILE;
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// Pid of the child currently writing a checkpoint (0 when idle)
+static pid_t checkpoint_child = 0;
+static pthread_mutex_t checkpoint_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// ==========================================
+// Child side: only async-signal-safe calls
+// (other threads may hold stdio/debug locks at fork time)
+
+static char out_buf[65536];
+static size_t out_len = 0;
+static int out_fd = -1;
+static int out_failed = 0;
+
+static void out_flush(void) {
+    size_t done = 0;
+    while (done < out_len && !out_failed) {
+        ssize_t n = write(out_fd, out_buf + done, out_len - done);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            out_failed = 1;
+            break;
+        }
+        done += n;
+    }
+    out_len = 0;
+}
+
+static void out_bytes(const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        if (out_len == sizeof(out_buf)) out_flush();
+        size_t chunk = sizeof(out_buf) - out_len;
+        if (chunk > len) chunk = len;
+        memcpy(out_buf + out_len, p, chunk);
+        out_len += chunk;
+        p += chunk;
+        len -= chunk;
+    }
+}
+
+static void out_int(int value) {
+    out_bytes(&value, sizeof(int));
+}
+
+static void out_string(const char *s) {
+    int len = strlen(s);
+    out_int(len);
+    out_bytes(s, len);
+}
+
+static void write_board(board_t *b) {
+    out_string(b->level->name);
+    out_int(b->width);
+    out_int(b->height);
+    out_int(b->tempo);
+
+    out_int(b->n_pacmans);
+    for (int p = 0; p < b->n_pacmans; p++) {
+        pacman_t *pac = &b->pacmans[p];
+        out_int(pac->pos_x); out_int(pac->pos_y);
+        out_int(pac->alive); out_int(pac->points);
+        out_int(pac->passo); out_int(pac->waiting);
+        out_int(pac->current_move); out_int(pac->turns_left);
+    }
+
+    out_int(b->n_ghosts);
+    for (int g = 0; g < b->n_ghosts; g++) {
+        ghost_t *ghost = &b->ghosts[g];
+        out_int(ghost->pos_x); out_int(ghost->pos_y);
+        out_int(ghost->passo); out_int(ghost->waiting);
+        out_int(ghost->charged); out_int(ghost->current_move);
+        out_int(ghost->turns_left);
+        // The scripts are static level data: the level name is enough to find them
+    }
+
+    // One byte per field keeps the grid compact (content, dot, portal)
+    for (int i = 0; i < b->width * b->height; i++) {
+        char cell[3] = { b->board[i].content, (char)b->board[i].has_dot, (char)b->board[i].has_portal };
+        out_bytes(cell, sizeof(cell));
+    }
+}
+
+static void write_checkpoint(const char *path, int n_allocated) {
+    char tmp_path[sizeof(checkpoint_file) + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    out_fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (out_fd == -1) _exit(1);
+
+    // Only parked sessions are frozen, a busy one would be caught halfway through its step
+    int n_sessions = 0, n_omitted = 0;
+    for (int i = 0; i < n_allocated; i++) {
+        if (session_at(i)->parked == 1 && session_at(i)->board) n_sessions++;
+        if (session_at(i)->parked == -1) n_omitted++;
+    }
+
+    // MAGIC | version | n_sessions | n_omitted | omitted session ids... | sessions...
+    out_bytes(CHECKPOINT_MAGIC, 4);
+    out_int(CHECKPOINT_VERSION);
+    out_int(n_sessions);
+    out_int(n_omitted);
+    for (int i = 0; i < n_allocated; i++) {
+        if (session_at(i)->parked == -1) out_int(session_at(i)->session_id);
+    }
+
+    for (int i = 0; i < n_allocated; i++) {
+        session_t *sess = session_at(i);
+        if (sess->parked != 1 || !sess->board) continue;
+        out_int(sess->session_id);
+        out_int(sess->current_level);
+        out_int(atomic_load(&sess->game_active));
+        out_int(atomic_load(&sess->victory));
+        write_board(sess->board);
+    }
+
+    out_flush();
+    if (fsync(out_fd) == -1) out_failed = 1;
+    close(out_fd);
+
+    // Rename is atomic: readers never observe a half written checkpoint
+    if (out_failed || rename(tmp_path, path) == -1) {
+        unlink(tmp_path);
+        _exit(1);
+    }
+    _exit(0);
+}
+
+// ==========================================
+// Parent side
+
+int checkpoint_poll(void) {
+    pthread_mutex_lock(&checkpoint_mutex);
+    int reaped = 0;
+    if (checkpoint_child > 0) {
+        int status;
+        pid_t r = waitpid(checkpoint_child, &status, WNOHANG);
+        if (r == checkpoint_child) {
+            if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                debug("Checkpoint %d failed\n", checkpoint_child);
+            }
+            checkpoint_child = 0;
+            reaped = 1;
+        } else if (r == -1) {
+            checkpoint_child = 0;
+        }
+    }
+    pthread_mutex_unlock(&checkpoint_mutex);
+    return reaped;
+}
+
+pid_t checkpoint_start(const char *path) {
+    checkpoint_poll();
+
+    pthread_mutex_lock(&checkpoint_mutex);
+    if (checkpoint_child > 0) {
+        // Previous child is still serializing, skip this round
+        pthread_mutex_unlock(&checkpoint_mutex);
+        return -1;
+    }
+
+    // Quiesce every session so the fork captures a consistent cut. No
+    // session_lock is held: a parked actor cannot step, and its reader cannot
+    // stop it and free the board until it is unparked (actor_stop waits), so
+    // a parked session stays in place while the others keep running.
+    // Every allocated session, those above max_games may still be playing
+    int n_allocated = atomic_load(&allocated_sessions);
+    int busy = 0;
+    for (int i = 0; i < n_allocated; i++) {
+        session_t *sess = session_at(i);
+        sess->parked = actor_park(sess, 0);
+        if (sess->parked == -1) busy++;
+    }
+
+    // Steps only play ticks and queue a frame, so the ones still running end
+    // shortly: wait for all of them. Only a stuck step outlasts the shared
+    // CHECKPOINT_PARK_MS, its session is then listed as omitted
+    uint64_t deadline = monotonic_ms() + CHECKPOINT_PARK_MS;
+    for (int i = 0; i < n_allocated && busy > 0; i++) {
+        session_t *sess = session_at(i);
+        if (sess->parked != -1) continue;
+        uint64_t now = monotonic_ms();
+        sess->parked = actor_park(sess, now < deadline ? (int)(deadline - now) : 0);
+        if (sess->parked != -1) busy--;
+    }
+    if (busy > 0) debug("Checkpoint: %d stuck sessions omitted\n", busy);
+
+    for (int i = 0; i < n_allocated; i++) {
+        session_t *sess = session_at(i);
+        // The ghosts of a quiet session are behind the schedule, the checkpoint shows them where they are
+        if (sess->parked == 1) session_idle_catch_up(sess);
+    }
+
+    pid_t child = fork();
+    if (child == 0) {
+        write_checkpoint(path, n_allocated);
+    }
+
+    for (int i = n_allocated - 1; i >= 0; i--) {
+        session_t *sess = session_at(i);
+        if (sess->parked == 1) actor_unpark(sess);
+    }
+
+    if (child > 0) checkpoint_child = child;
+    pthread_mutex_unlock(&checkpoint_mutex);
+
+    if (child < 0) debug("Checkpoint fork failed\n");
+    return child;
+}
+
+void* checkpoint_thread(void* arg) {
+    (void)arg;
+    debug("Checkpoint thread started (every %d ms -> %s)\n", checkpoint_interval_ms, checkpoint_file);
+
+    int elapsed = 0;
+    while (server_running) {
+        // Short slices so shutdown is not delayed by long intervals
+        sleep_ms(100);
+        elapsed += 100;
+        checkpoint_poll();
+        if (elapsed < checkpoint_interval_ms) continue;
+        elapsed = 0;
+        checkpoint_start(checkpoint_file);
+    }
+
+    // Wait for an in-flight checkpoint so it is not left half written
+    pthread_mutex_lock(&checkpoint_mutex);
+    if (checkpoint_child > 0) waitpid(checkpoint_child, NULL, 0);
+    checkpoint_child = 0;
+    pthread_mutex_unlock(&checkpoint_mutex);
+
+    debug("Checkpoint thread ended\n");
+    return NULL;
+}
@@ -0,0 +1,519 @@
+// mmap flags (MAP_ANONYMOUS, MAP_NORESERVE) are not part of POSIX
+#define _DEFAULT_SOURCE
+#include "coro.h"
+#include "server.h"
+#include "debug.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <ucontext.h>
+#include <sys/epoll.h>
+#include <sys/mman.h>
+
+// TSan follows the stack switches through its fiber API
+#if defined(__SANITIZE_THREAD__)
+#include <sanitizer/tsan_interface.h>
+#define TSAN_FIBERS 1
+#endif
+
+typedef struct coro_loop coro_loop_t;
+
+struct coro {
+    ucontext_t ctx;
+    char *stack;                // Mapping base (guard page first)
+    coro_fn_t fn;
+    void *arg;
+    coro_loop_t *loop;
+    struct coro *next;          // Run queue / incoming list
+    int done;
+
+    // Suspension
+    int waiting;                // Cleared by the first wake (fd or timer)
+    int ready;                  // Woken by the fd rather than the timer
+    uint64_t wake_at;           // Timer deadline in ns (0 for none)
+    int timer_index;            // Position in the loop's heap (-1 if none)
+
+    // coro_wait: watched fds and coro_wake
+    int in_wait;                // Suspended in coro_wait (other waits ignore these wakes)
+    int pending;                // A wake came while it was not in coro_wait
+    int wake_queued;            // On the loop's woken list (under incoming_lock)
+    int zombie;                 // Returned with a wake queued, freed when the wake is drained
+    struct coro *wake_next;     // Woken list
+    struct coro *all_prev, *all_next; // Every coroutine of the loop
+#ifdef TSAN_FIBERS
+    void *fiber;
+#endif
+};
+
+struct coro_loop {
+    pthread_t thread;
+    int epfd;
+    int wake_pipe[2];           // Spawns and stop requests from other threads
+
+    pthread_mutex_t incoming_lock;
+    coro_t *incoming;
+    coro_t *woken;              // coro_wake from other threads
+    int stopping;
+
+    // Owned by the loop thread
+    coro_t *run_head, *run_tail;
+    coro_t *all;
+    coro_t **timers;            // Min-heap on wake_at
+    int n_timers, timers_capacity;
+    int n_coros;
+    coro_t *current;
+    ucontext_t sched_ctx;
+#ifdef TSAN_FIBERS
+    void *fiber;
+#endif
+};
+
+static coro_loop_t *loops = NULL;
+static int n_loops = 0;
+static _Atomic unsigned next_loop = 0;
+static size_t page_size = 4096;
+
+static _Thread_local coro_loop_t *this_loop = NULL;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+// ==========================================
+// Timer heap
+
+static void heap_set(coro_loop_t *loop, int i, coro_t *c) {
+    loop->timers[i] = c;
+    c->timer_index = i;
+}
+
+static void heap_up(coro_loop_t *loop, int i) {
+    coro_t *c = loop->timers[i];
+    while (i > 0 && loop->timers[(i - 1) / 2]->wake_at > c->wake_at) {
+        heap_set(loop, i, loop->timers[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    heap_set(loop, i, c);
+}
+
+static void heap_down(coro_loop_t *loop, int i) {
+    coro_t *c = loop->timers[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= loop->n_timers) break;
+        if (child + 1 < loop->n_timers && loop->timers[child + 1]->wake_at < loop->timers[child]->wake_at) child++;
+        if (loop->timers[child]->wake_at >= c->wake_at) break;
+        heap_set(loop, i, loop->timers[child]);
+        i = child;
+    }
+    heap_set(loop, i, c);
+}
+
+static int timer_add(coro_loop_t *loop, coro_t *c) {
+    if (loop->n_timers == loop->timers_capacity) {
+        int capacity = loop->timers_capacity ? loop->timers_capacity * 2 : 64;
+        coro_t **timers = realloc(loop->timers, capacity * sizeof(coro_t*));
+        if (!timers) return -1;
+        loop->timers = timers;
+        loop->timers_capacity = capacity;
+    }
+    heap_set(loop, loop->n_timers++, c);
+    heap_up(loop, c->timer_index);
+    return 0;
+}
+
+static void timer_remove(coro_loop_t *loop, coro_t *c) {
+    int i = c->timer_index;
+    if (i < 0) return;
+    c->timer_index = -1;
+    coro_t *last = loop->timers[--loop->n_timers];
+    if (i == loop->n_timers) return;
+    heap_set(loop, i, last);
+    heap_up(loop, i);
+    heap_down(loop, last->timer_index);
+}
+
+// ==========================================
+// Switching
+
+static void make_runnable(coro_loop_t *loop, coro_t *c) {
+    c->next = NULL;
+    if (loop->run_tail) loop->run_tail->next = c; else loop->run_head = c;
+    loop->run_tail = c;
+}
+
+static void wake(coro_loop_t *loop, coro_t *c, int ready) {
+    if (!c->waiting) return;
+    c->waiting = 0;
+    c->ready = ready;
+    timer_remove(loop, c);
+    make_runnable(loop, c);
+}
+
+// A watched fd or coro_wake: resumes a coroutine in coro_wait, or is kept for its next one
+static void notify(coro_loop_t *loop, coro_t *c) {
+    if (c->waiting && c->in_wait) wake(loop, c, 1);
+    else c->pending = 1;
+}
+
+// Back to the loop (the coroutine is resumed by a wake, or freed when done)
+static void suspend(coro_t *c) {
+#ifdef TSAN_FIBERS
+    __tsan_switch_to_fiber(c->loop->fiber, 0);
+#endif
+    swapcontext(&c->ctx, &c->loop->sched_ctx);
+}
+
+static void resume(coro_loop_t *loop, coro_t *c) {
+    loop->current = c;
+#ifdef TSAN_FIBERS
+    __tsan_switch_to_fiber(c->fiber, 0);
+#endif
+    swapcontext(&loop->sched_ctx, &c->ctx);
+    loop->current = NULL;
+}
+
+static void trampoline(void) {
+    coro_t *c = this_loop->current;
+    c->fn(c->arg);
+    c->done = 1;
+    suspend(c);
+}
+
+static void coro_free(coro_t *c) {
+#ifdef TSAN_FIBERS
+    __tsan_destroy_fiber(c->fiber);
+#endif
+    munmap(c->stack, CORO_STACK_SIZE + page_size);
+    free(c);
+}
+
+// ==========================================
+// Loop thread
+
+static void drain_incoming(coro_loop_t *loop, int *stopping) {
+    char drain[64];
+    while (read(loop->wake_pipe[0], drain, sizeof(drain)) > 0);
+
+    coro_t *zombies = NULL;
+    pthread_mutex_lock(&loop->incoming_lock);
+    coro_t *list = loop->incoming;
+    loop->incoming = NULL;
+    *stopping = loop->stopping;
+    // Handled under the lock: once wake_queued is cleared another thread may queue c again
+    coro_t *woken = loop->woken;
+    loop->woken = NULL;
+    while (woken) {
+        coro_t *c = woken;
+        woken = c->wake_next;
+        c->wake_queued = 0;
+        if (c->zombie) {
+            c->next = zombies;
+            zombies = c;
+        } else {
+            notify(loop, c);
+        }
+    }
+    pthread_mutex_unlock(&loop->incoming_lock);
+
+    while (zombies) {
+        coro_t *c = zombies;
+        zombies = c->next;
+        coro_free(c);
+    }
+
+    while (list) {
+        coro_t *c = list;
+        list = list->next;
+        loop->n_coros++;
+        c->all_prev = NULL;
+        c->all_next = loop->all;
+        if (loop->all) loop->all->all_prev = c;
+        loop->all = c;
+        make_runnable(loop, c);
+    }
+
+    // Coroutines waiting for their pipes or a wake would never see the runtime stop
+    if (*stopping) {
+        for (coro_t *c = loop->all; c; c = c->all_next) notify(loop, c);
+    }
+}
+
+// A returned coroutine is freed now, or by drain_incoming if a wake for it is still queued
+static void retire(coro_loop_t *loop, coro_t *c) {
+    loop->n_coros--;
+    if (c->all_prev) c->all_prev->all_next = c->all_next; else loop->all = c->all_next;
+    if (c->all_next) c->all_next->all_prev = c->all_prev;
+
+    pthread_mutex_lock(&loop->incoming_lock);
+    int queued = c->wake_queued;
+    if (queued) c->zombie = 1;
+    pthread_mutex_unlock(&loop->incoming_lock);
+    if (!queued) coro_free(c);
+}
+
+static void* loop_main(void* arg) {
+    coro_loop_t *loop = arg;
+    sigset_t mask; sigemptyset(&mask); sigaddset(&mask, SIGUSR1); sigaddset(&mask, SIGUSR2); pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    this_loop = loop;
+#ifdef TSAN_FIBERS
+    loop->fiber = __tsan_get_current_fiber();
+#endif
+
+    struct epoll_event events[CORO_MAX_EVENTS];
+    int stopping = 0;
+    for (;;) {
+        drain_incoming(loop, &stopping);
+
+        // Run everything runnable; coroutines woken meanwhile wait for the next round
+        coro_t *run = loop->run_head;
+        loop->run_head = loop->run_tail = NULL;
+        while (run) {
+            coro_t *c = run;
+            run = run->next;
+            resume(loop, c);
+            if (c->done) retire(loop, c);
+        }
+
+        if (stopping && loop->n_coros == 0) {
+            // Frees the coroutines that returned with a wake still queued
+            drain_incoming(loop, &stopping);
+            break;
+        }
+        if (loop->run_head) continue;
+
+        int timeout = -1;
+        if (loop->n_timers > 0) {
+            uint64_t now = now_ns(), first = loop->timers[0]->wake_at;
+            timeout = first > now ? (int)((first - now + 999999) / 1000000) : 0;
+        }
+        int n = epoll_wait(loop->epfd, events, CORO_MAX_EVENTS, timeout);
+        for (int i = 0; i < n; i++) {
+            // Watched fds carry the coroutine with the low bit set, coro_wait_fd without it
+            uint64_t tag = events[i].data.u64;
+            if (!tag) continue;
+            coro_t *c = (coro_t*)(uintptr_t)(tag & ~(uint64_t)1);
+            if (tag & 1) notify(loop, c);
+            else wake(loop, c, 1);
+        }
+
+        uint64_t now = now_ns();
+        while (loop->n_timers > 0 && loop->timers[0]->wake_at <= now) {
+            wake(loop, loop->timers[0], 0);
+        }
+    }
+    return NULL;
+}
+
+// ==========================================
+// Public API
+
+// Epoll instance and wake pipe of a loop. Returns 0 on success, otherwise nothing is left open
+static int loop_init(coro_loop_t *loop) {
+    loop->epfd = epoll_create1(0);
+    if (loop->epfd == -1) return -1;
+    if (pipe(loop->wake_pipe) == -1) {
+        close(loop->epfd);
+        return -1;
+    }
+    fcntl(loop->wake_pipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(loop->wake_pipe[1], F_SETFL, O_NONBLOCK);
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = 0 };
+    epoll_ctl(loop->epfd, EPOLL_CTL_ADD, loop->wake_pipe[0], &ev);
+    pthread_mutex_init(&loop->incoming_lock, NULL);
+    return 0;
+}
+
+// Asks the running loops to stop once their coroutines return and joins them
+static void loops_join(void) {
+    for (int i = 0; i < n_loops; i++) {
+        pthread_mutex_lock(&loops[i].incoming_lock);
+        loops[i].stopping = 1;
+        pthread_mutex_unlock(&loops[i].incoming_lock);
+        if (write(loops[i].wake_pipe[1], "", 1) == -1) {}
+    }
+    for (int i = 0; i < n_loops; i++) pthread_join(loops[i].thread, NULL);
+    n_loops = 0;
+}
+
+// Releases the first count initialized loops, their threads already joined
+static void loops_destroy(int count) {
+    for (int i = 0; loops && i < count; i++) {
+        close(loops[i].epfd);
+        close(loops[i].wake_pipe[0]);
+        close(loops[i].wake_pipe[1]);
+        pthread_mutex_destroy(&loops[i].incoming_lock);
+        free(loops[i].timers);
+    }
+    free(loops);
+    loops = NULL;
+}
+
+static int n_initialized = 0;   // Loops loop_init set up (n_loops of them are running)
+
+int coro_runtime_start(int count) {
+    if (count <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cores > 0 ? (int)cores : 1;
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    if (page > 0) page_size = (size_t)page;
+
+    loops = calloc(count, sizeof(coro_loop_t));
+    if (!loops) return -1;
+    for (n_initialized = 0; n_initialized < count; n_initialized++) {
+        if (loop_init(&loops[n_initialized]) != 0) break;
+    }
+    for (int i = 0; n_initialized == count && i < count; i++) {
+        if (pthread_create(&loops[i].thread, NULL, loop_main, &loops[i]) != 0) break;
+        n_loops++;
+    }
+    if (n_loops < count) {
+        // Partial start: nothing was spawned yet, the loops that run stop at once
+        loops_join();
+        loops_destroy(n_initialized);
+        n_initialized = 0;
+        return -1;
+    }
+    debug("Coroutine runtime started with %d loops\n", n_loops);
+    return 0;
+}
+
+void coro_runtime_stop(void) {
+    loops_join();
+    loops_destroy(n_initialized);
+    n_initialized = 0;
+}
+
+int coro_spawn(coro_fn_t fn, void *arg) {
+    if (n_loops == 0) return -1;
+    coro_t *c = calloc(1, sizeof(coro_t));
+    if (!c) return -1;
+
+    // Reserved, not committed: only the pages the handler touches cost memory
+    c->stack = mmap(NULL, CORO_STACK_SIZE + page_size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (c->stack == MAP_FAILED) { free(c); return -1; }
+    mprotect(c->stack, page_size, PROT_NONE);
+
+    coro_loop_t *loop = &loops[atomic_fetch_add(&next_loop, 1) % n_loops];
+    c->fn = fn;
+    c->arg = arg;
+    c->loop = loop;
+    c->timer_index = -1;
+    getcontext(&c->ctx);
+    c->ctx.uc_stack.ss_sp = c->stack + page_size;
+    c->ctx.uc_stack.ss_size = CORO_STACK_SIZE;
+    c->ctx.uc_link = NULL;
+    makecontext(&c->ctx, trampoline, 0);
+#ifdef TSAN_FIBERS
+    c->fiber = __tsan_create_fiber(0);
+#endif
+
+    pthread_mutex_lock(&loop->incoming_lock);
+    c->next = loop->incoming;
+    loop->incoming = c;
+    pthread_mutex_unlock(&loop->incoming_lock);
+    if (write(loop->wake_pipe[1], "", 1) == -1) {} // Full pipe: a wake up is already pending
+    return 0;
+}
+
+int coro_active(void) {
+    return this_loop != NULL && this_loop->current != NULL;
+}
+
+coro_t* coro_self(void) {
+    return coro_active() ? this_loop->current : NULL;
+}
+
+int coro_wait_fd(int fd, short events, int timeout_ms) {
+    if (!coro_active()) {
+        struct pollfd pfd = { .fd = fd, .events = events };
+        return poll(&pfd, 1, timeout_ms) > 0;
+    }
+    coro_loop_t *loop = this_loop;
+    coro_t *c = loop->current;
+
+    struct epoll_event ev = { .events = 0, .data.ptr = c };
+    if (events & POLLIN) ev.events |= EPOLLIN;
+    if (events & POLLOUT) ev.events |= EPOLLOUT;
+    if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) == -1) return 1; // Let the caller's read report it
+    c->wake_at = 0;
+    if (timeout_ms >= 0) {
+        c->wake_at = now_ns() + (uint64_t)timeout_ms * 1000000ULL;
+        // Without its timer the wait could last forever
+        if (timer_add(loop, c) != 0) {
+            epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+            return -1;
+        }
+    }
+    c->waiting = 1;
+    suspend(c);
+
+    epoll_ctl(loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+    return c->ready;
+}
+
+int coro_sleep_ms(int ms) {
+    if (!coro_active()) {
+        sleep_ms(ms);
+        return 0;
+    }
+    coro_loop_t *loop = this_loop;
+    coro_t *c = loop->current;
+    c->wake_at = now_ns() + (uint64_t)ms * 1000000ULL;
+    // Sleeping on the loop thread would freeze every coroutine of the loop
+    if (timer_add(loop, c) != 0) return -1;
+    c->waiting = 1;
+    suspend(c);
+    return 0;
+}
+
+int coro_watch_fd(int fd, short events) {
+    if (!coro_active()) return -1;
+    struct epoll_event ev = { .events = EPOLLET, .data.u64 = (uint64_t)(uintptr_t)this_loop->current | 1 };
+    if (events & POLLIN) ev.events |= EPOLLIN;
+    if (events & POLLOUT) ev.events |= EPOLLOUT;
+    return epoll_ctl(this_loop->epfd, EPOLL_CTL_ADD, fd, &ev) == -1 ? -1 : 0;
+}
+
+void coro_unwatch_fd(int fd) {
+    if (coro_active()) epoll_ctl(this_loop->epfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+void coro_wait(void) {
+    if (!coro_active()) {
+        sleep_ms(1);
+        return;
+    }
+    coro_t *c = this_loop->current;
+    if (!c->pending) {
+        c->wake_at = 0;
+        c->in_wait = 1;
+        c->waiting = 1;
+        suspend(c);
+        c->in_wait = 0;
+    }
+    c->pending = 0;
+}
+
+void coro_wake(coro_t *c) {
+    coro_loop_t *loop = c->loop;
+    pthread_mutex_lock(&loop->incoming_lock);
+    int queued = c->wake_queued;
+    if (!queued) {
+        c->wake_queued = 1;
+        c->wake_next = loop->woken;
+        loop->woken = c;
+    }
+    pthread_mutex_unlock(&loop->incoming_lock);
+    if (!queued && write(loop->wake_pipe[1], "", 1) == -1) {} // Full pipe: a wake up is already pending
+}
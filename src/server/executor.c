@@ -0,0 +1,175 @@
+#include "executor.h"
+#include "server.h"
+#include "debug.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdatomic.h>
+
+typedef struct {
+    task_fn_t fn;
+    void *arg;
+} task_t;
+
+// Owner works at bottom, thieves take from top (indices only grow, masked on access)
+typedef struct {
+    _Alignas(CACHE_LINE_SIZE) pthread_mutex_t lock;
+    unsigned top;
+    unsigned bottom;
+    pthread_t thread;
+    task_t tasks[EXECUTOR_DEQUE_SIZE];
+} worker_t;
+
+static worker_t *workers = NULL;
+static int n_workers = 0;
+
+// Idle workers sleep on idle_cond until queued becomes non zero
+static pthread_mutex_t idle_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t idle_cond = PTHREAD_COND_INITIALIZER;
+static int sleeping = 0;
+static int running = 0;
+static _Atomic int queued = 0;
+static _Atomic unsigned next_deque = 0;
+
+static _Thread_local int self = -1;   // Index of the calling worker (-1 outside the pool)
+static _Thread_local unsigned rng = 0;
+
+static int push_bottom(worker_t *w, task_t task) {
+    pthread_mutex_lock(&w->lock);
+    if (w->bottom - w->top == EXECUTOR_DEQUE_SIZE) {
+        pthread_mutex_unlock(&w->lock);
+        return -1;
+    }
+    w->tasks[w->bottom++ & (EXECUTOR_DEQUE_SIZE - 1)] = task;
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+// Newest first keeps the owner on data that is still in its cache
+static int pop_bottom(worker_t *w, task_t *task) {
+    pthread_mutex_lock(&w->lock);
+    if (w->bottom == w->top) {
+        pthread_mutex_unlock(&w->lock);
+        return -1;
+    }
+    *task = w->tasks[--w->bottom & (EXECUTOR_DEQUE_SIZE - 1)];
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+static int steal_top(worker_t *w, task_t *task) {
+    pthread_mutex_lock(&w->lock);
+    if (w->bottom == w->top) {
+        pthread_mutex_unlock(&w->lock);
+        return -1;
+    }
+    *task = w->tasks[w->top++ & (EXECUTOR_DEQUE_SIZE - 1)];
+    pthread_mutex_unlock(&w->lock);
+    return 0;
+}
+
+// Own deque first, then every other worker starting from a random victim
+static int find_task(int id, task_t *task) {
+    if (pop_bottom(&workers[id], task) == 0) return 0;
+    rng = rng * 1103515245u + 12345u;
+    int start = (rng >> 16) % n_workers;
+    for (int i = 0; i < n_workers; i++) {
+        int victim = (start + i) % n_workers;
+        if (victim != id && steal_top(&workers[victim], task) == 0) return 0;
+    }
+    return -1;
+}
+
+static void* worker_main(void* arg) {
+    int id = (int)(intptr_t)arg;
+    sigset_t mask; sigemptyset(&mask); sigaddset(&mask, SIGUSR1); sigaddset(&mask, SIGUSR2); pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    self = id;
+    rng = (unsigned)id * 2654435761u + 1;
+
+    for (;;) {
+        task_t task;
+        if (find_task(id, &task) == 0) {
+            atomic_fetch_sub(&queued, 1);
+            task.fn(task.arg);
+            continue;
+        }
+        pthread_mutex_lock(&idle_lock);
+        // Exits only once stopping and nothing is left to run
+        if (!running && atomic_load(&queued) == 0) {
+            pthread_mutex_unlock(&idle_lock);
+            break;
+        }
+        if (atomic_load(&queued) == 0) {
+            sleeping++;
+            pthread_cond_wait(&idle_cond, &idle_lock);
+            sleeping--;
+        }
+        pthread_mutex_unlock(&idle_lock);
+    }
+    return NULL;
+}
+
+int executor_start(int count) {
+    if (count <= 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        count = cores > 0 ? (int)cores : 1;
+    }
+    workers = aligned_alloc(CACHE_LINE_SIZE, count * sizeof(worker_t));
+    if (!workers) return -1;
+    memset(workers, 0, count * sizeof(worker_t));
+    for (int i = 0; i < count; i++) pthread_mutex_init(&workers[i].lock, NULL);
+
+    running = 1;
+    n_workers = count;
+    for (int i = 0; i < count; i++) {
+        if (pthread_create(&workers[i].thread, NULL, worker_main, (void*)(intptr_t)i) != 0) {
+            // Keep the workers that did start
+            n_workers = i;
+            break;
+        }
+    }
+    if (n_workers == 0) {
+        running = 0;
+        free(workers);
+        workers = NULL;
+        return -1;
+    }
+    debug("Executor started with %d workers\n", n_workers);
+    return 0;
+}
+
+int executor_workers(void) {
+    return n_workers;
+}
+
+void executor_submit(task_fn_t fn, void *arg) {
+    task_t task = { fn, arg };
+    int first = self >= 0 ? self : (int)(atomic_fetch_add(&next_deque, 1) % n_workers);
+    int pushed = 0;
+    for (int i = 0; i < n_workers && !pushed; i++) {
+        pushed = push_bottom(&workers[(first + i) % n_workers], task) == 0;
+    }
+    if (!pushed) {
+        fn(arg);
+        return;
+    }
+    pthread_mutex_lock(&idle_lock);
+    atomic_fetch_add(&queued, 1);
+    if (sleeping > 0) pthread_cond_signal(&idle_cond);
+    pthread_mutex_unlock(&idle_lock);
+}
+
+void executor_stop(void) {
+    if (!workers) return;
+    pthread_mutex_lock(&idle_lock);
+    running = 0;
+    pthread_cond_broadcast(&idle_cond);
+    pthread_mutex_unlock(&idle_lock);
+
+    for (int i = 0; i < n_workers; i++) pthread_join(workers[i].thread, NULL);
+    for (int i = 0; i < n_workers; i++) pthread_mutex_destroy(&workers[i].lock);
+    free(workers);
+    workers = NULL;
+    n_workers = 0;
+}
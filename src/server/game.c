@@ -1,19 +1,23 @@
 #include "board.h"
+#include "parser.h"
 #include "display.h"
+#include "simulation.h"
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
 #include <sys/types.h>
 #include <dirent.h>
 #include <unistd.h>
-#include <sys/wait.h>
 #include <pthread.h>
+#include <stdatomic.h>
 
-#define CONTINUE_PLAY 0
-#define NEXT_LEVEL 1
-#define QUIT_GAME 2
-#define LOAD_BACKUP 3
-#define CREATE_BACKUP 4
+// Render cadence of the simulation mode, independent of the level tempo
+#define SIM_FRAME_INTERVAL_MS 33
+// Keys typed faster than the tempo wait here, one is played per tick
+#define SIM_INPUT_QUEUE 8
+
+// Headless mode defaults
+#define HEADLESS_MAX_TICKS 100000
 
 typedef struct {
     board_t *board;
@@ -22,44 +26,47 @@ typedef struct {
 
 int thread_shutdown = 0;
 
-int create_backup() {
-    // clear the terminal for process transition
-    terminal_cleanup();
-
-    pid_t child = fork();
-
-    if(child != 0) {
-        if (child < 0) {
-            return -1;
-        }
-
-        return child;
-    } else {
-        debug("[%d] Created\n", getpid());
-
-        return 0;
-    }
-}
-
 void screen_refresh(board_t * game_board, int mode) {
     debug("REFRESH\n");
     draw_board(game_board, mode);
     refresh_screen();     
 }
 
+// Status line drawn while a level is being played
+static void level_menu(board_t *board, char *menu, size_t size) {
+    snprintf(menu, size, "Level: %s | Use W/A/S/D to move | Q to quit | G to quicksave ", board->level->name);
+}
+
 void* ncurses_thread(void *arg) {
     board_t *board = (board_t*) arg;
+
+    // The frame is copied under a short write lock and drawn outside it,
+    // so the entity threads never wait for the terminal
+    char menu[MAX_FILENAME + 64];
+    level_menu(board, menu, sizeof(menu));
+    char *frame = malloc(board->width * board->height + 1);
+    Board view = { .width = board->width, .height = board->height, .tempo = board->tempo, .data = frame };
+    display_invalidate();
+
     sleep_ms(board->tempo / 2);
     while (true) {
         sleep_ms(board->tempo);
         pthread_rwlock_wrlock(&board->state_lock);
         if (thread_shutdown) {
             pthread_rwlock_unlock(&board->state_lock);
-            pthread_exit(NULL);
+            break;
         }
-        screen_refresh(board, DRAW_MENU);
+        fill_board_displayed(board, frame);
+        view.accumulated_points = board->pacmans[0].points;
         pthread_rwlock_unlock(&board->state_lock);
+
+        debug("REFRESH\n");
+        draw_board_frame(view, menu);
+        refresh_screen();
     }
+
+    free(frame);
+    return NULL;
 }
 
 void* pacman_thread(void *arg) {
@@ -77,7 +84,7 @@ void* pacman_thread(void *arg) {
 
         sleep_ms(board->tempo * (1 + pacman->passo));
 
-        command_t* play;
+        const command_t* play;
         command_t c;
         if (pacman->n_moves == 0) {
             c.command = get_input();
@@ -150,14 +157,265 @@ void* ghost_thread(void *arg) {
     }
 }
 
+// Runs the level with one thread per entity until the pacman thread returns
+int run_threads(board_t *board) {
+    pthread_t ncurses_tid, pacman_tid;
+    pthread_t *ghost_tids = malloc(board->n_ghosts * sizeof(pthread_t));
+
+    thread_shutdown = 0;
+
+    debug("Creating threads\n");
+
+    pthread_create(&pacman_tid, NULL, pacman_thread, (void*) board);
+    for (int i = 0; i < board->n_ghosts; i++) {
+        ghost_thread_arg_t *arg = malloc(sizeof(ghost_thread_arg_t));
+        arg->board = board;
+        arg->ghost_index = i;
+        pthread_create(&ghost_tids[i], NULL, ghost_thread, (void*) arg);
+    }
+    pthread_create(&ncurses_tid, NULL, ncurses_thread, (void*) board);
+
+    int *retval;
+    pthread_join(pacman_tid, (void**)&retval);
+
+    pthread_rwlock_wrlock(&board->state_lock);
+    thread_shutdown = 1;
+    pthread_rwlock_unlock(&board->state_lock);
+
+    pthread_join(ncurses_tid, NULL);
+    for (int i = 0; i < board->n_ghosts; i++) {
+        pthread_join(ghost_tids[i], NULL);
+    }
+
+    free(ghost_tids);
+
+    int result = *retval;
+    free(retval);
+    return result;
+}
+
+// ==========================================
+// Simulation mode (--sim): one thread advances every entity in a fixed order
+// each tick and publishes a snapshot; the main thread reads input and renders
+// the snapshot at its own cadence. No per-entity threads, no state_lock.
+
+typedef struct {
+    board_t *board;
+    pthread_mutex_t lock;   // Protects everything below
+    char *snapshot;         // Last published frame (get_board_displayed format)
+    int points;
+    unsigned long version;  // Bumped on every publish
+    char input[SIM_INPUT_QUEUE]; // Keys pressed, oldest first, one consumed per tick
+    int n_input;
+    int done;
+    int result;
+} simulation_t;
+
+void* simulation_thread(void *arg) {
+    simulation_t *sim = (simulation_t*) arg;
+    board_t *board = sim->board;
+    char *frame = malloc(board->width * board->height + 1);
+
+    int result = CONTINUE_PLAY;
+    while (result == CONTINUE_PLAY) {
+        sleep_ms(board->tempo);
+
+        pthread_mutex_lock(&sim->lock);
+        char key = '\0';
+        if (sim->n_input > 0) {
+            key = sim->input[0];
+            memmove(sim->input, sim->input + 1, --sim->n_input);
+        }
+        pthread_mutex_unlock(&sim->lock);
+
+        // The board is only touched by this thread: serialize without locks,
+        // then publish with a short copy
+        result = simulation_tick(board, key);
+        fill_board_displayed(board, frame);
+
+        pthread_mutex_lock(&sim->lock);
+        memcpy(sim->snapshot, frame, board->width * board->height + 1);
+        sim->points = board->pacmans[0].points;
+        sim->version++;
+        pthread_mutex_unlock(&sim->lock);
+    }
+
+    free(frame);
+
+    pthread_mutex_lock(&sim->lock);
+    sim->result = result;
+    sim->done = 1;
+    pthread_mutex_unlock(&sim->lock);
+    return NULL;
+}
+
+// Runs the level until the pacman needs the main loop (same results as pacman_thread)
+int run_simulation(board_t *board) {
+    int cells = board->width * board->height;
+    simulation_t sim = { .board = board };
+    pthread_mutex_init(&sim.lock, NULL);
+    sim.snapshot = malloc(cells + 1);
+    fill_board_displayed(board, sim.snapshot);
+    sim.points = board->pacmans[0].points;
+
+    char *frame = malloc(cells + 1);
+    Board view = { .width = board->width, .height = board->height, .tempo = board->tempo, .data = frame };
+    char menu[MAX_FILENAME + 64];
+    level_menu(board, menu, sizeof(menu));
+
+    pthread_t sim_tid;
+    pthread_create(&sim_tid, NULL, simulation_thread, (void*) &sim);
+
+    display_invalidate();
+    set_timeout(SIM_FRAME_INTERVAL_MS);
+
+    unsigned long drawn = (unsigned long)-1;
+    int done = 0;
+    while (!done) {
+        // getch doubles as the frame timer
+        char key = get_input();
+
+        pthread_mutex_lock(&sim.lock);
+        if (key != '\0' && sim.n_input < SIM_INPUT_QUEUE) sim.input[sim.n_input++] = key;
+        done = sim.done;
+        unsigned long version = sim.version;
+        if (version != drawn) {
+            memcpy(frame, sim.snapshot, cells + 1);
+            view.accumulated_points = sim.points;
+        }
+        pthread_mutex_unlock(&sim.lock);
+
+        // Draw outside the lock: the simulation never waits for ncurses
+        if (version != drawn) {
+            draw_board_frame(view, menu);
+            refresh_screen();
+            drawn = version;
+        }
+    }
+
+    pthread_join(sim_tid, NULL);
+
+    int result = sim.result;
+    free(frame);
+    free(sim.snapshot);
+    pthread_mutex_destroy(&sim.lock);
+    return result;
+}
+
+// ==========================================
+// Headless mode (--headless): every level of the directory is played with its
+// .p/.m scripts, once per seed, without ncurses and without pacing by tempo.
+// Jobs run on a pool of worker threads; results are printed in level/seed order.
+
+typedef struct {
+    const char *level;
+    uint64_t seed;
+    const char *outcome;
+    int ticks;
+    int points;
+} headless_job_t;
+
+typedef struct {
+    char *dirname;
+    headless_job_t *jobs;
+    int max_ticks;
+} headless_t;
+
+static void run_headless_job(void *ctx, int index) {
+    headless_t *h = (headless_t*) ctx;
+    headless_job_t *job = &h->jobs[index];
+    board_t board;
+    if (load_level(&board, (char*) job->level, h->dirname, 0) != 0) {
+        job->outcome = "error";
+        return;
+    }
+    read_pacman_moves(&board);
+    seed_board_rng(&board, job->seed);
+
+    save_ring_t saves = {0};
+    save_ring_reset(&saves, &board);
+
+    int result = CONTINUE_PLAY;
+    int ticks = 0;
+    while (ticks < h->max_ticks && result == CONTINUE_PLAY) {
+        result = simulation_step(&board, &saves);
+        ticks++;
+    }
+
+    switch (result) {
+        case NEXT_LEVEL: job->outcome = "won"; break;
+        case LOAD_BACKUP: job->outcome = "died"; break;
+        case QUIT_GAME: job->outcome = "quit"; break;
+        default: job->outcome = "timeout"; break;
+    }
+    job->ticks = ticks;
+    job->points = board.pacmans[0].points;
+
+    save_ring_free(&saves);
+    unload_level(&board);
+}
+
+int run_headless(char *dirname, int seeds, int n_workers, int max_ticks) {
+    char **levels;
+    int n_levels = list_level_files(dirname, &levels);
+    if (n_levels < 0) {
+        fprintf(stderr, "Failed to open directory: %s\n", dirname);
+        return 1;
+    }
+
+    int n_jobs = n_levels * seeds;
+    headless_t h = { .dirname = dirname, .max_ticks = max_ticks };
+    h.jobs = calloc(n_jobs > 0 ? n_jobs : 1, sizeof(headless_job_t));
+    for (int l = 0; l < n_levels; l++) {
+        for (int s = 0; s < seeds; s++) {
+            h.jobs[l * seeds + s].level = levels[l];
+            h.jobs[l * seeds + s].seed = (uint64_t) s;
+        }
+    }
+
+    run_jobs(n_jobs, n_workers, run_headless_job, &h);
+
+    printf("%-24s %8s %-8s %8s %8s\n", "level", "seed", "outcome", "ticks", "points");
+    for (int i = 0; i < n_jobs; i++) {
+        headless_job_t *job = &h.jobs[i];
+        printf("%-24s %8llu %-8s %8d %8d\n", job->level, (unsigned long long) job->seed,
+               job->outcome, job->ticks, job->points);
+    }
+
+    free(h.jobs);
+    free_level_files(levels, n_levels);
+    return 0;
+}
+
 int main(int argc, char** argv) {
-    if (argc != 2) {
-        printf("Usage: %s <level_directory>\n", argv[0]);
+    bool sim_mode = false, headless = false, bad_args = argc < 2;
+    int seeds = 1, max_ticks = HEADLESS_MAX_TICKS;
+    int jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    for (int i = 2; i < argc && !bad_args; i++) {
+        if (strcmp(argv[i], "--sim") == 0) sim_mode = true;
+        else if (strcmp(argv[i], "--headless") == 0) headless = true;
+        else if (strcmp(argv[i], "--seeds") == 0 && i + 1 < argc) seeds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) jobs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-ticks") == 0 && i + 1 < argc) max_ticks = atoi(argv[++i]);
+        else bad_args = true;
+    }
+    if (bad_args || seeds < 1 || jobs < 1 || max_ticks < 1) {
+        printf("Usage: %s <level_directory> [--sim]\n"
+               "       %s <level_directory> --headless [--seeds N] [--jobs N] [--max-ticks N]\n",
+               argv[0], argv[0]);
         return -1;
     }
 
+    if (headless) {
+        // Parsing and entity logs would dominate the run time
+        open_debug_file("/dev/null");
+        int status = run_headless(argv[1], seeds, jobs, max_ticks);
+        close_debug_file();
+        return status;
+    }
+
     // Random seed for any random movements
-    srand((unsigned int)time(NULL));
+    uint64_t seed = (uint64_t)time(NULL);
 
     DIR* level_dir = opendir(argv[1]);
         
@@ -173,8 +431,7 @@ int main(int argc, char** argv) {
     int accumulated_points = 0;
     bool end_game = false;
     board_t game_board;
-
-    pid_t parent_process = getpid(); // Only the parent process can create backups
+    save_ring_t saves = {0};
 
     struct dirent* entry;
     while ((entry = readdir(level_dir)) != NULL && !end_game) {
@@ -185,42 +442,24 @@ int main(int argc, char** argv) {
 
         if (strcmp(dot, ".lvl") == 0) {
             load_level(&game_board, entry->d_name, argv[1], accumulated_points);
+            // The pacman and ghost threads move the board at the same time
+            if (!sim_mode && board_enable_cell_locks(&game_board) != 0) {
+                debug("Failed to allocate cell locks\n");
+                unload_level(&game_board);
+                break;
+            }
+            seed_board_rng(&game_board, seed++);
+            // Savepoints do not carry over to the next level
+            if (save_ring_reset(&saves, &game_board) != 0) {
+                debug("Failed to allocate savepoints\n");
+                unload_level(&game_board);
+                break;
+            }
             draw_board(&game_board, DRAW_MENU);
             refresh_screen();
 
             while(true) {
-                pthread_t ncurses_tid, pacman_tid;
-                pthread_t *ghost_tids = malloc(game_board.n_ghosts * sizeof(pthread_t));
-
-                thread_shutdown = 0;
-
-                debug("Creating threads\n");
-
-                pthread_create(&pacman_tid, NULL, pacman_thread, (void*) &game_board);
-                for (int i = 0; i < game_board.n_ghosts; i++) {
-                    ghost_thread_arg_t *arg = malloc(sizeof(ghost_thread_arg_t));
-                    arg->board = &game_board;
-                    arg->ghost_index = i;
-                    pthread_create(&ghost_tids[i], NULL, ghost_thread, (void*) arg);
-                }
-                pthread_create(&ncurses_tid, NULL, ncurses_thread, (void*) &game_board);
-
-                int *retval;
-                pthread_join(pacman_tid, (void**)&retval);
-
-                pthread_rwlock_wrlock(&game_board.state_lock);
-                thread_shutdown = 1;
-                pthread_rwlock_unlock(&game_board.state_lock);
-
-                pthread_join(ncurses_tid, NULL);
-                for (int i = 0; i < game_board.n_ghosts; i++) {
-                    pthread_join(ghost_tids[i], NULL);
-                }
-
-                free(ghost_tids);
-
-                int result = *retval;
-                free(retval);
+                int result = sim_mode ? run_simulation(&game_board) : run_threads(&game_board);
 
                 if(result == NEXT_LEVEL) {
                     screen_refresh(&game_board, DRAW_WIN);
@@ -229,58 +468,15 @@ int main(int argc, char** argv) {
                 }
 
                 if(result == CREATE_BACKUP) {
-                    debug("CREATE_BACKUP\n");
-                    if (parent_process == getpid()) {
-                        debug("PARENT\n");
-                        pid_t child = create_backup();
-                        if (child == -1) {
-                            // failed to fork
-                            debug("[%d] Failed to create backup\n", getpid());
-                            end_game = true;
-                            break;
-                        }
-                        if (child > 0) {
-                            debug("Parent process\n");
-                            int status;
-                            wait(&status);
-
-                            if (WIFEXITED(status)) {
-                                int code = WEXITSTATUS(status);
-                                
-                                if (code == 1) {
-                                    terminal_init();
-                                    debug("[%d] Save Resuming...\n", getpid());
-                                }
-                                else { // End game or error
-                                    end_game = true;
-                                    break;
-                                }
-                            }
-                        } else {
-                            terminal_init();
-                            debug("Child process\n");
-                        }
-
-                    } else {
-                        debug("[%d] Only parent process can have a save\n", getpid());
-                    }
+                    save_push(&saves, &game_board);
+                    debug("Saved (%d savepoints)\n", saves.count);
                 }
 
                 if(result == LOAD_BACKUP) {
-                    if(getpid() != parent_process) {
-                        terminal_cleanup();
-                        unload_level(&game_board);
-                        
-                        close_debug_file();
-
-                        if (closedir(level_dir) == -1) {
-                            fprintf(stderr, "Failed to close directory\n");
-                            return 0;
-                        }
-
-                        return 1;
+                    if (save_pop(&saves, &game_board) == 0) {
+                        debug("Rewound to savepoint (%d left)\n", saves.count);
                     } else {
-                        // No backup process, game over
+                        // No savepoint, game over
                         result = QUIT_GAME;
                     }
                 }
@@ -301,6 +497,8 @@ int main(int argc, char** argv) {
         }
     }    
 
+    save_ring_free(&saves);
+
     terminal_cleanup();
 
     close_debug_file();
@@ -0,0 +1,222 @@
+#include "recorder.h"
+#include "recording.h"
+#include "board.h"
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+char record_file[256] = "";
+
+// Double buffered writer: producers append to the active buffer while the
+// writer thread flushes the other one to disk
+typedef struct {
+    int fd;
+    unsigned char *buffers[2];
+    size_t len;                 // Bytes in the active buffer
+    int active;                 // Buffer producers append to
+    int running;
+    pthread_t writer;
+    pthread_mutex_t mutex;
+    pthread_cond_t has_data;    // Wakes the writer
+    unsigned long dropped;      // Records that found the buffer full
+} recorder_t;
+
+static recorder_t recorder = { .fd = -1 };
+static _Atomic unsigned long next_session_key = 1;
+
+static void write_all(int fd, const unsigned char *data, size_t len) {
+    size_t done = 0;
+    while (done < len) {
+        ssize_t n = write(fd, data + done, len - done);
+        if (n == -1) {
+            if (errno == EINTR) continue;
+            debug("Recorder: write failed: %s\n", strerror(errno));
+            return;
+        }
+        done += n;
+    }
+}
+
+static void* recorder_writer(void* arg) {
+    (void)arg;
+    pthread_mutex_lock(&recorder.mutex);
+    while (1) {
+        while (recorder.running && recorder.len < RECORDER_BUFFER_SIZE / 2) {
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            deadline.tv_nsec += RECORDER_FLUSH_MS * 1000000L;
+            deadline.tv_sec += deadline.tv_nsec / 1000000000L;
+            deadline.tv_nsec %= 1000000000L;
+            if (pthread_cond_timedwait(&recorder.has_data, &recorder.mutex, &deadline) == ETIMEDOUT) break;
+        }
+        if (recorder.len == 0) {
+            if (!recorder.running) break;
+            continue;
+        }
+
+        // Swap buffers and write the full one without holding the mutex
+        unsigned char *out = recorder.buffers[recorder.active];
+        size_t out_len = recorder.len;
+        recorder.active ^= 1;
+        recorder.len = 0;
+        pthread_mutex_unlock(&recorder.mutex);
+
+        write_all(recorder.fd, out, out_len);
+
+        pthread_mutex_lock(&recorder.mutex);
+    }
+    pthread_mutex_unlock(&recorder.mutex);
+    return NULL;
+}
+
+int recorder_open(const char *path) {
+    recorder.fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (recorder.fd == -1) return -1;
+
+    recorder.buffers[0] = malloc(RECORDER_BUFFER_SIZE);
+    recorder.buffers[1] = malloc(RECORDER_BUFFER_SIZE);
+    if (!recorder.buffers[0] || !recorder.buffers[1]) {
+        free(recorder.buffers[0]); free(recorder.buffers[1]);
+        close(recorder.fd); recorder.fd = -1;
+        return -1;
+    }
+
+    // MAGIC | version
+    unsigned char header[4 + MAX_VARINT_BYTES];
+    memcpy(header, RECORDING_MAGIC, 4);
+    int len = 4 + varint_encode(RECORDING_VERSION, header + 4);
+    write_all(recorder.fd, header, len);
+
+    recorder.len = 0;
+    recorder.active = 0;
+    recorder.running = 1;
+    recorder.dropped = 0;
+    pthread_mutex_init(&recorder.mutex, NULL);
+    pthread_cond_init(&recorder.has_data, NULL);
+
+    if (pthread_create(&recorder.writer, NULL, recorder_writer, NULL) != 0) {
+        recorder.running = 0;
+        recorder_close();
+        return -1;
+    }
+    debug("Recording sessions to %s\n", path);
+    return 0;
+}
+
+void recorder_close(void) {
+    if (recorder.fd == -1) return;
+
+    pthread_mutex_lock(&recorder.mutex);
+    int was_running = recorder.running;
+    recorder.running = 0;
+    pthread_cond_signal(&recorder.has_data);
+    pthread_mutex_unlock(&recorder.mutex);
+
+    if (was_running) pthread_join(recorder.writer, NULL);
+    if (recorder.dropped > 0) debug("Recorder: %lu records dropped, the buffer was full\n", recorder.dropped);
+
+    pthread_mutex_destroy(&recorder.mutex);
+    pthread_cond_destroy(&recorder.has_data);
+    free(recorder.buffers[0]);
+    free(recorder.buffers[1]);
+    close(recorder.fd);
+    recorder.fd = -1;
+}
+
+int recorder_enabled(void) {
+    return recorder.fd != -1;
+}
+
+// Producers run on executor workers and must not wait for the disk: a
+// record that does not fit is dropped. Returns 0 when it was buffered
+static int recorder_append(const unsigned char *data, size_t len) {
+    pthread_mutex_lock(&recorder.mutex);
+    int result = -1;
+    if (recorder.running && recorder.len + len <= RECORDER_BUFFER_SIZE) {
+        memcpy(recorder.buffers[recorder.active] + recorder.len, data, len);
+        recorder.len += len;
+        if (recorder.len >= RECORDER_BUFFER_SIZE / 2) pthread_cond_signal(&recorder.has_data);
+        result = 0;
+    } else if (recorder.running) {
+        recorder.dropped++;
+        pthread_cond_signal(&recorder.has_data);
+    }
+    pthread_mutex_unlock(&recorder.mutex);
+    return result;
+}
+
+// Type | key | tick delta (since the previous record written for this session)
+static int record_header(session_t *sess, record_type_t type, int tick_delta, unsigned char *out) {
+    int len = 0;
+    out[len++] = (unsigned char)type;
+    len += varint_encode(sess->record_key, out + len);
+    len += varint_encode(tick_delta, out + len);
+    return len;
+}
+
+// A REC_GAP (type and 3 varints) in front of the largest record, REC_LEVEL (type, 4 varints and the name)
+#define RECORD_MAX_BYTES ((1 + 3 * MAX_VARINT_BYTES) + (1 + 4 * MAX_VARINT_BYTES + MAX_FILENAME))
+
+// Writes a record of the session, after a REC_GAP if earlier ones were dropped
+static void record_write(session_t *sess, record_type_t type, const unsigned char *body, int body_len) {
+    unsigned char rec[RECORD_MAX_BYTES];
+    int len = 0;
+    int tick_delta = sess->tick - sess->recorded_tick;
+    if (sess->record_lost > 0) {
+        len += record_header(sess, REC_GAP, tick_delta, rec + len);
+        len += varint_encode(sess->record_lost, rec + len);
+        tick_delta = 0;
+    }
+    len += record_header(sess, type, tick_delta, rec + len);
+    if (body_len > 0) memcpy(rec + len, body, body_len);
+    len += body_len;
+
+    if (recorder_append(rec, len) == 0) {
+        sess->recorded_tick = sess->tick;
+        sess->record_lost = 0;
+    } else {
+        sess->record_lost++;
+    }
+}
+
+void record_session_start(session_t *sess) {
+    if (!recorder_enabled()) return;
+    sess->record_key = next_session_key++;
+    sess->recorded_tick = sess->tick;
+
+    unsigned char rec[1 + 3 * MAX_VARINT_BYTES];
+    int len = 0;
+    rec[len++] = REC_SESSION;
+    len += varint_encode(sess->record_key, rec + len);
+    len += varint_encode((unsigned int)sess->session_id, rec + len);
+    len += varint_encode(sess->seed, rec + len);
+    // Without its start the session cannot be replayed: the gap says so
+    sess->record_lost = (recorder_append(rec, len) == 0) ? 0 : 1;
+}
+
+void record_level(session_t *sess, const char *level_file, int points) {
+    if (!recorder_enabled()) return;
+    unsigned char body[2 * MAX_VARINT_BYTES + MAX_FILENAME];
+    size_t name_len = strnlen(level_file, MAX_FILENAME - 1);
+    int len = varint_encode(name_len, body);
+    memcpy(body + len, level_file, name_len);
+    len += name_len;
+    len += varint_encode(points, body + len);
+    record_write(sess, REC_LEVEL, body, len);
+}
+
+void record_play(session_t *sess, char command) {
+    if (!recorder_enabled()) return;
+    unsigned char body[1] = { (unsigned char)command };
+    record_write(sess, REC_PLAY, body, 1);
+}
+
+void record_end(session_t *sess) {
+    if (!recorder_enabled()) return;
+    record_write(sess, REC_END, NULL, 0);
+}
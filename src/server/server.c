@@ -1,6 +1,13 @@
 #include "board.h"
 #include "display.h"
 #include "server.h"
+#include "checkpoint.h"
+#include "recorder.h"
+#include "lockprof.h"
+#include "executor.h"
+#include "ticker.h"
+#include "coro.h"
+#include "actor.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -9,30 +16,47 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/select.h>
+#include <poll.h>
 #include <dirent.h>
 #include <errno.h>
 #include <pthread.h>
 #include <signal.h>
 #include <stdatomic.h>
+#include <time.h>
 
 // ===================
 // 1. GLOBALS AND STATE
 
-session_t *sessions = NULL; 
-int max_games = 0;
+session_segment_t *session_segments[MAX_SESSION_SEGMENTS];
+_Atomic int allocated_sessions = 0;
+_Atomic int max_games = 0;
+// Serializes resizes and owns the list of manager threads started so far
+pthread_mutex_t resize_mutex = PTHREAD_MUTEX_INITIALIZER;
+pthread_t *manager_tids = NULL;
+int n_manager_tids = 0, manager_tids_capacity = 0;
 connection_buffer_t conn_buffer; 
 _Atomic int server_running = 1;
 _Atomic int sigusr1_received = 0;
+_Atomic int sigusr2_received = 0;
 char registry_pipe[MAX_PIPE_PATH_LENGTH];
+char admin_pipe[ADMIN_PIPE_PATH_LENGTH];
+int resize_limit = 0;
 char levels_dir[256];
 int shutdown_pipe[2]; 
+int executor_threads = 0;   // --workers (0 for one per core)
+int coro_loops = 0;         // --loops (0 for one per core)
 
 // Cache to avoid directory access (opendir/readdir) during critical game loops
 char cached_level_files[100][256];
+// Parsed once and shared by every session playing the level (NULL if it failed to load)
+level_t *cached_levels[100];
 int cached_num_levels = 0;
+// Largest level in the cache, every session arena is sized for it
+int max_level_cells = 0, max_level_pacmans = 0, max_level_ghosts = 0;
 
 /**
- * Pre-loads level filenames into memory to reduce I/O latency during gameplay.
+ * Pre-loads level filenames and their static data into memory to reduce I/O
+ * latency during gameplay.
  */
 void init_level_cache(const char *dir_path) {
     DIR* level_dir = opendir(dir_path);
@@ -49,7 +73,13 @@ void init_level_cache(const char *dir_path) {
         if (len > 4 && strcmp(entry->d_name + len - 4, ".lvl") == 0) {
             strncpy(cached_level_files[cached_num_levels], entry->d_name, 255);
             cached_level_files[cached_num_levels][255] = '\0';
+            level_t *level = level_load(cached_level_files[cached_num_levels], (char*)dir_path);
+            cached_levels[cached_num_levels] = level;
             cached_num_levels++;
+            if (!level) continue;
+            if (level->width * level->height > max_level_cells) max_level_cells = level->width * level->height;
+            if (level->n_pacmans > max_level_pacmans) max_level_pacmans = level->n_pacmans;
+            if (level->n_ghosts > max_level_ghosts) max_level_ghosts = level->n_ghosts;
         }
     }
     closedir(level_dir);
@@ -57,13 +87,13 @@ void init_level_cache(const char *dir_path) {
 
 void send_board_update(session_t *sess);
 int load_next_level(session_t *sess);
-void* update_sender(void* arg);
 
 // ===============================================
 // 2. CONNECTION BUFFER MANAGEMENT (Infrastructure)
 
 void init_connection_buffer(connection_buffer_t *buffer) {
-    buffer->in = 0; buffer->out = 0; buffer->active = 1;
+    buffer->in = 0; buffer->out = 0; buffer->count = 0; buffer->active = 1;
+    buffer->consumers = 0; buffer->retiring = 0;
     
     // Unlink previous semaphores to ensure a clean state if the server crashed previously
     sem_unlink("/pacmanist_empty"); sem_unlink("/pacmanist_full");
@@ -106,6 +136,7 @@ void buffer_insert(connection_buffer_t *buffer, connection_request_t *request) {
     if (buffer->active) {
         buffer->requests[buffer->in] = *request;
         buffer->in = (buffer->in + 1) % BUFFER_SIZE;
+        buffer->count++;
         sem_post(buffer->full); 
     } else {
         sem_post(buffer->empty); // Restore semaphore count if inactive
@@ -118,19 +149,51 @@ int buffer_remove(connection_buffer_t *buffer, connection_request_t *request) {
     if (sem_wait(buffer->full) != 0) return -1; 
 
     pthread_mutex_lock(&buffer->mutex);
-    if (buffer->active) {
+    if (buffer->active && buffer->retiring > 0) {
+        buffer->retiring--;
+        buffer->consumers--;
+        pthread_mutex_unlock(&buffer->mutex);
+        return 1;
+    }
+    if (buffer->active && buffer->count > 0) {
         *request = buffer->requests[buffer->out];
         buffer->out = (buffer->out + 1) % BUFFER_SIZE;
+        buffer->count--;
         sem_post(buffer->empty); 
         pthread_mutex_unlock(&buffer->mutex);
         return 0;
     }
+    if (buffer->active) {
+        // Wake up left by a cancelled retirement
+        pthread_mutex_unlock(&buffer->mutex);
+        return -1;
+    }
     
     sem_post(buffer->full); // Restore semaphore count if inactive
     pthread_mutex_unlock(&buffer->mutex);
     return -1;
 }
 
+int buffer_set_consumers(connection_buffer_t *buffer, int wanted) {
+    pthread_mutex_lock(&buffer->mutex);
+    int staying = buffer->consumers - buffer->retiring;
+    int spawn = 0;
+    if (wanted > staying) {
+        // Consumers not yet retired are kept before new ones are started
+        int kept = wanted - staying < buffer->retiring ? wanted - staying : buffer->retiring;
+        buffer->retiring -= kept;
+        spawn = wanted - staying - kept;
+        buffer->consumers += spawn;
+    } else {
+        for (int i = staying; i > wanted; i--) {
+            buffer->retiring++;
+            sem_post(buffer->full);
+        }
+    }
+    pthread_mutex_unlock(&buffer->mutex);
+    return spawn;
+}
+
 // =========================================
 // 3. LEVELS, RESOURCES AND SCORING (Helpers)
 
@@ -138,8 +201,8 @@ void free_session_resources(session_t *sess) {
     if (sess->req_fd != -1) { close(sess->req_fd); sess->req_fd = -1; }
     if (sess->notif_fd != -1) { close(sess->notif_fd); sess->notif_fd = -1; }
     if (sess->board != NULL) {
-        unload_level(sess->board);
-        free(sess->board);
+        // The arena keeps its memory and mutexes for the next game in this slot
+        board_arena_unload(&sess->arena);
         sess->board = NULL;
     }
     sess->game_active = 0; 
@@ -156,21 +219,16 @@ int load_next_level(session_t *sess) {
     // Preserve points from the previous level if applicable
     if (sess->board && sess->board->n_pacmans > 0) accumulated_points = sess->board->pacmans[0].points;
 
-    if (sess->board) unload_level(sess->board);
-    else {
-        sess->board = malloc(sizeof(board_t));
-        if (!sess->board) {
-            debug("Session %d: Failed to allocate board memory\n", sess->session_id);
-            return -1;
-        }
-    }
-
     debug("Session %d: Loading %s\n", sess->session_id, cached_level_files[sess->current_level]);
-    
-    if (load_level(sess->board, cached_level_files[sess->current_level], levels_dir, 0) != 0) return -1;
 
-    // Restore accumulated points to the new pacman instance
-    if (sess->board->n_pacmans > 0) sess->board->pacmans[0].points = accumulated_points;
+    // No allocation: the level's starting state is copied into the session's arena
+    level_t *level = cached_levels[sess->current_level];
+    if (sess->board) board_arena_unload(&sess->arena);
+    sess->board = level ? board_arena_load(&sess->arena, level, accumulated_points) : NULL;
+    if (!sess->board) return -1;
+
+    seed_board_rng(sess->board, level_seed(sess->seed, sess->current_level));
+    record_level(sess, cached_level_files[sess->current_level], accumulated_points);
     return 0;
 }
 
@@ -184,8 +242,10 @@ int compare_scores(const void *a, const void *b) {
 void generate_top5_file() {
     debug("Generating top 5 clients file...\n");
     
+    // Sessions above max_games after a shrink may still be playing
+    int n_sessions = atomic_load(&allocated_sessions);
     // Dynamic allocation to avoid stack overflow when max_games is large
-    struct score_entry *scores = malloc(max_games * sizeof(struct score_entry));
+    struct score_entry *scores = malloc((n_sessions > 0 ? n_sessions : 1) * sizeof(struct score_entry));
     if (!scores) {
         debug("Failed to allocate memory for scores\n");
         return; 
@@ -194,14 +254,16 @@ void generate_top5_file() {
     int num = 0;
 
     // Quick snapshot of active game data 
-    for (int i = 0; i < max_games; i++) {
-        pthread_mutex_lock(&sessions[i].session_lock);
-        if (sessions[i].active && sessions[i].board) {
-            scores[num].id = sessions[i].session_id;
-            scores[num].pts = (sessions[i].board->n_pacmans > 0) ? sessions[i].board->pacmans[0].points : 0;
+    for (int i = 0; i < n_sessions; i++) {
+        session_t *sess = session_at(i);
+        prof_mutex_lock(LOCK_CLASS_SESSION, &sess->session_lock);
+        // The board belongs to the session's actor: use the points it publishes
+        if (sess->active) {
+            scores[num].id = sess->session_id;
+            scores[num].pts = atomic_load(&sess->points);
             num++;
         }
-        pthread_mutex_unlock(&sessions[i].session_lock);
+        prof_mutex_unlock(&sess->session_lock);
     }
     
     // Quicksort the scores
@@ -229,21 +291,61 @@ void generate_top5_file() {
 // ==========================
 // 4. GAME LOGIC AND PROTOCOL
 
-// Serializes and sends the board update to the client
+// FNV-1a, only used to recognise a repeated frame
+static uint64_t frame_hash(const char *msg, int len) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (int i = 0; i < len; i++) {
+        hash ^= (unsigned char)msg[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Writes what the client has room for, returns 1 once nothing is pending
+static int flush_output(session_t *sess) {
+    while (sess->out_sent < sess->out_len) {
+        ssize_t n = write(sess->notif_fd, sess->out_buf + sess->out_sent, sess->out_len - sess->out_sent);
+        if (n > 0) {
+            sess->out_sent += n;
+            continue;
+        }
+        if (n == -1 && errno == EINTR) continue;
+        if (n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            // The reader watches the pipe and asks for another step when the client reads
+            atomic_store(&sess->out_blocked, 1);
+            coro_wake(sess->reader);
+            return 0;
+        }
+        break; // Client gone, its reader sees the request pipe close
+    }
+    sess->out_len = sess->out_sent = 0;
+    return 1;
+}
+
+// Serializes and sends the board update to the client (actor only, so the board is never half moved)
 void send_board_update(session_t *sess) {
     if (!sess->board || sess->notif_fd == -1) return;
     board_t *b = sess->board;
-    
-    // Large buffer to avoid overflows on large maps
-    char msg[16384]; 
+
+    // The client must get the rest of a half written frame before a newer one
+    if (sess->out_sent > 0 && !flush_output(sess)) {
+        sess->out_stale = 1;
+        return;
+    }
+    sess->out_stale = 0;
+
+    // Replaces a frame still waiting for room, the client only needs the newest
+    char *msg = sess->out_buf;
     int off = 0;
 
-    // Fixed Header
-    msg[off++] = OP_CODE_BOARD;
+    // Fixed Header (clients that tag their input, or lost batched commands, also get the seq and drop count)
+    int seq_frame = sess->last_seq >= 0 || sess->batch_left > 0 || sess->dropped_commands > 0;
+    msg[off++] = seq_frame ? OP_CODE_BOARD_SEQ : OP_CODE_BOARD;
     memcpy(msg + off, &b->width, sizeof(int)); off += sizeof(int);
     memcpy(msg + off, &b->height, sizeof(int)); off += sizeof(int);
     memcpy(msg + off, &b->tempo, sizeof(int)); off += sizeof(int);
-    memcpy(msg + off, &sess->victory, sizeof(int)); off += sizeof(int);
+    int victory_val = atomic_load(&sess->victory);
+    memcpy(msg + off, &victory_val, sizeof(int)); off += sizeof(int);
     
     int game_over_val = (b->n_pacmans > 0 && !b->pacmans[0].alive) ? 1 : 0;
     memcpy(msg + off, &game_over_val, sizeof(int)); off += sizeof(int);
@@ -251,6 +353,11 @@ void send_board_update(session_t *sess) {
     int points_val = (b->n_pacmans > 0) ? b->pacmans[0].points : 0;
     memcpy(msg + off, &points_val, sizeof(int)); off += sizeof(int);
 
+    if (seq_frame) {
+        memcpy(msg + off, &sess->last_seq, sizeof(int)); off += sizeof(int);
+        memcpy(msg + off, &sess->dropped_commands, sizeof(int)); off += sizeof(int);
+    }
+
     int total_cells = b->width * b->height;
     
     // Serialize grid content
@@ -271,134 +378,330 @@ void send_board_update(session_t *sess) {
         msg[off++] = out_char;
     }
     
-    if (write(sess->notif_fd, msg, off) == -1) {} // Ignore pipe errors (client likely disconnected)
+    // A frame equal to the last one sent tells the client nothing
+    uint64_t hash = frame_hash(msg, off);
+    if (off == sess->last_frame_len && hash == sess->last_frame_hash) return;
+    sess->last_frame_len = off;
+    sess->last_frame_hash = hash;
+
+    sess->out_len = off;
+    sess->out_sent = 0;
+    flush_output(sess);
 }
 
-// Process the result of a move (Portal entry or Death)
+// Queues the disconnect ack behind a half written frame (one nobody started is dropped)
+static void send_disconnect_ack(session_t *sess) {
+    if (sess->out_sent == 0) sess->out_len = 0;
+    sess->out_buf[sess->out_len++] = OP_CODE_DISCONNECT;
+    sess->out_buf[sess->out_len++] = 0;
+    flush_output(sess);
+}
+
+// Process the result of a move (Portal entry or Death), returns 0 when the game is over
 int handle_move_result(session_t *sess, int result) {
     if (result == REACHED_PORTAL) {
         debug("Session %d: Pacman reached portal!\n", sess->session_id);
-        
-        pthread_mutex_lock(&sess->session_lock);
         sess->current_level++;
         
         // Load next level
         if (load_next_level(sess) != 0) {
-            sess->victory = 1; // All levels completed
-            sess->game_active = 0;
-            send_board_update(sess);
-            pthread_mutex_unlock(&sess->session_lock);
+            atomic_store(&sess->victory, 1); // All levels completed
+            atomic_store(&sess->game_active, 0);
             return 0; 
         }
         
-        sess->game_active = 1;
-        send_board_update(sess);
-        pthread_mutex_unlock(&sess->session_lock);
-        
-        // Restart the update sender thread for the new level
-        if (pthread_create(&sess->update_thread, NULL, update_sender, sess) != 0) {
-            debug("Session %d: Failed to restart update thread\n", sess->session_id);
-            pthread_mutex_lock(&sess->session_lock);
-            sess->game_active = 0;
-            pthread_mutex_unlock(&sess->session_lock);
-            return 0;
-        }
-        return 2; // Level transitioned
+        // Ghost ticks restart at the new level's tempo (queued when the step ends)
+        ticker_arm(sess);
+        return 1;
     } 
     
     if (result == DEAD_PACMAN) {
         debug("Session %d: Pacman died!\n", sess->session_id);
-        pthread_mutex_lock(&sess->session_lock);
-        sess->game_active = 0;
-        send_board_update(sess);
-        pthread_mutex_unlock(&sess->session_lock);
+        atomic_store(&sess->game_active, 0);
         return 0; // Game over
     }
     
     return 1; // Normal gameplay continues
 }
 
+// Applies one pacman command (seq >= 0 when the client tags its inputs)
+// Returns 0 when the game is over
+static int apply_play(session_t *sess, char command, int seq) {
+    if (!sess->board || sess->board->n_pacmans <= 0) return 1;
+    command_t cmd = { .command = command, .turns = 1 };
+    record_play(sess, cmd.command);
+    int res = move_pacman(sess->board, 0, &cmd);
+    // Acknowledged in the frame that shows the move
+    if (seq >= 0) sess->last_seq = seq;
+    return handle_move_result(sess, res);
+}
+
+// Queues a batched command; they are played one per ghost tick. The last
+// command of a tagged batch (seq >= 0) gets the batch acked once played
+static void enqueue_command(session_t *sess, char command, int seq) {
+    if (sess->queue_len == CMD_QUEUE_SIZE) {
+        // The client sees the count grow in its next BOARD_SEQ frame
+        sess->dropped_commands++;
+        debug("Session %d: Command queue full, dropped a command\n", sess->session_id);
+    } else {
+        sess->cmd_queue[(sess->queue_head + sess->queue_len) % CMD_QUEUE_SIZE] = command;
+        sess->queue_len++;
+    }
+    if (seq < 0) return;
+    // Acking a later batch acks the earlier ones, only the latest is tracked
+    sess->batch_seq = seq;
+    sess->batch_left = sess->queue_len;
+    if (sess->batch_left == 0) sess->last_seq = seq;
+}
+
+static char next_queued_command(session_t *sess) {
+    if (sess->queue_len == 0) return '\0';
+    char command = sess->cmd_queue[sess->queue_head];
+    sess->queue_head = (sess->queue_head + 1) % CMD_QUEUE_SIZE;
+    sess->queue_len--;
+    // Acked in the frame that shows the move
+    if (sess->batch_left > 0 && --sess->batch_left == 0) sess->last_seq = sess->batch_seq;
+    return command;
+}
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void session_idle_catch_up(session_t *sess) {
+    if (sess->idle_ticks == 0 || !sess->board) return;
+    uint64_t now = monotonic_ns();
+    uint64_t interval = (uint64_t)sess->tick_interval_ms * 1000000ULL;
+    // Quiet ticks whose deadline has passed (the last one parked is a real tick, it stays due)
+    int elapsed = 0;
+    if (now >= sess->idle_base) {
+        uint64_t passed = (now - sess->idle_base) / interval + 1;
+        elapsed = passed < (uint64_t)sess->idle_ticks ? (int)passed : sess->idle_ticks;
+    }
+    board_skip_ticks(sess->board, elapsed);
+    sess->tick += elapsed;
+    sess->idle_ticks = 0;
+    atomic_store_explicit(&sess->tick_deadline, sess->idle_base + (uint64_t)elapsed * interval, memory_order_relaxed);
+}
+
+// Moves the deadline past the ticks that cannot change the board, the session sleeps until then or until input
+static void park_if_quiet(session_t *sess) {
+    if (!atomic_load(&sess->game_active) || !sess->board || sess->queue_len > 0 || sess->idle_ticks > 0) return;
+    int quiet = board_quiet_ticks(sess->board, PARK_MAX_TICKS);
+    if (quiet == 0) return;
+    sess->idle_base = atomic_load_explicit(&sess->tick_deadline, memory_order_relaxed);
+    sess->idle_ticks = quiet;
+    atomic_store_explicit(&sess->tick_deadline, sess->idle_base + (uint64_t)quiet * sess->tick_interval_ms * 1000000ULL, memory_order_relaxed);
+}
+
+/*
+One step of the session's actor: catches up on the quiet ticks it slept
+through, applies the mail, then the ghost ticks that are due (each with the
+next batched command before it), then sends a single frame showing
+everything and parks again if the ghosts have nothing to do. Runs on an executor
+worker, never concurrently with itself, so the board needs no lock.
+*/
+void session_actor_step(session_t *sess) {
+    int changed = 0;
+    int was_active = atomic_load(&sess->game_active);
+    mail_t mail;
+    // Input is applied to the ghosts as they are now, not as they were when the session parked
+    session_idle_catch_up(sess);
+
+    // What the client had no room for goes first (MAIL_FLUSH woke us once it had); a frame
+    // held back behind a half written one is due now
+    if (sess->out_len > 0 && flush_output(sess) && sess->out_stale) changed = 1;
+
+    while (actor_take(sess, &mail)) {
+        if (mail.op == OP_CODE_DISCONNECT) {
+            atomic_store(&sess->game_active, 0);
+            atomic_store_explicit(&sess->tick_deadline, UINT64_MAX, memory_order_relaxed);
+            send_disconnect_ack(sess);
+            coro_wake(sess->reader);
+            return;
+        }
+        if (mail.op == MAIL_FLUSH || !atomic_load(&sess->game_active)) continue;
+        if (mail.op == OP_CODE_PLAY_BATCH) {
+            enqueue_command(sess, mail.command, mail.seq);
+            continue;
+        }
+        changed = 1;
+        if (!apply_play(sess, mail.command, mail.op == OP_CODE_PLAY_SEQ ? mail.seq : -1)) break;
+    }
+    // A reader stuck on a full mailbox has room again
+    if (atomic_exchange(&sess->mail_waiting, 0)) coro_wake(sess->reader);
+
+    // Ticks missed during a stall are played back to back, ticker_advance skips what is too far behind
+    uint64_t now = monotonic_ns();
+    for (int played = 0; played <= tick_catchup_max && atomic_load(&sess->game_active) && sess->board &&
+         now >= atomic_load_explicit(&sess->tick_deadline, memory_order_relaxed); played++) {
+        changed = 1;
+        char queued = next_queued_command(sess);
+        if (queued == '\0' || apply_play(sess, queued, -1)) {
+            // A portal reached by the queued command already rescheduled the level's ticks
+            if (queued == '\0' || now >= atomic_load_explicit(&sess->tick_deadline, memory_order_relaxed)) {
+                move_ghosts(sess->board);
+                sess->tick++;
+                ticker_advance(sess, now);
+            }
+        }
+    }
+
+    if (changed) {
+        send_board_update(sess);
+        if (sess->board && sess->board->n_pacmans > 0) atomic_store(&sess->points, sess->board->pacmans[0].points);
+    }
+    park_if_quiet(sess);
+    // A finished game has no more ticks, the ticker must not claim it until the reader stops it
+    if (!atomic_load(&sess->game_active)) {
+        atomic_store_explicit(&sess->tick_deadline, UINT64_MAX, memory_order_relaxed);
+        // The reader sleeps until input: tell it the game is over
+        if (was_active) coro_wake(sess->reader);
+    }
+}
+
 // ============================
 // 5. THREADS (Execution Logic)
 
-// Thread dedicated to moving ghosts and sending periodic updates
-void* update_sender(void* arg) {
-    session_t *sess = (session_t*)arg;
-    int keep_running = 1;
-    while (keep_running) {
-        pthread_mutex_lock(&sess->session_lock);
-        keep_running = sess->game_active;
-        if (!sess->game_active || !sess->board) { pthread_mutex_unlock(&sess->session_lock); break; }
-        int tempo = sess->board->tempo;
-        pthread_mutex_unlock(&sess->session_lock);
-
-        // Control game speed
-        sleep_ms(tempo);
-
-        pthread_mutex_lock(&sess->session_lock);
-        if (sess->game_active && sess->board) {
-            board_t *b = sess->board;
-            pthread_rwlock_wrlock(&b->state_lock);
-            
-            // Execute ghost AI logic
-            for (int i = 0; i < b->n_ghosts; i++) {
-                if (b->ghosts[i].n_moves > 0)
-                    move_ghost(b, i, &b->ghosts[i].moves[b->ghosts[i].current_move % b->ghosts[i].n_moves]);
+// Posts to the actor's mailbox. When full, suspends until the actor's step has drained it
+static void post_mail(session_t *sess, const mail_t *mail) {
+    while (actor_post(sess, mail) != 0 && server_running) {
+        atomic_store(&sess->mail_waiting, 1);
+        // The step may have drained the box before it could see the flag
+        if (actor_post(sess, mail) == 0) break;
+        actor_notify(sess);
+        // Other wakes (input, room in the pipe) just retry, the read loop checks them again
+        coro_wait();
+    }
+}
+
+static int pipe_has_room(int fd) {
+    struct pollfd pfd = { .fd = fd, .events = POLLOUT };
+    return poll(&pfd, 1, 0) > 0;
+}
+
+// Parses the request at the start of msg into the actor's mailbox; returns the bytes consumed (0 if incomplete)
+static int post_request(session_t *sess, const char *msg, int len, int *keep_running) {
+    mail_t mail = { .op = msg[0], .command = 0, .seq = -1 };
+    switch (msg[0]) {
+        case OP_CODE_DISCONNECT:
+            *keep_running = 0;
+            post_mail(sess, &mail);
+            return 1;
+        case OP_CODE_PLAY:
+            if (len < 2) return 0;
+            mail.command = msg[1];
+            post_mail(sess, &mail);
+            return 2;
+        case OP_CODE_PLAY_BATCH: {
+            if (len < PLAY_BATCH_HEADER_SIZE) return 0;
+            int n, seq;
+            memcpy(&n, msg + 1, sizeof(int));
+            memcpy(&seq, msg + 1 + sizeof(int), sizeof(int));
+            if (n < 0 || n > MAX_BATCH_COMMANDS) {
+                debug("Session %d: Invalid batch size %d - ignoring\n", sess->session_id, n);
+                return 1;
             }
-            
-            pthread_rwlock_unlock(&b->state_lock);
-            
-            if (sess->game_active && sess->board) send_board_update(sess);
+            if (len < PLAY_BATCH_HEADER_SIZE + n) return 0;
+            for (int i = 0; i < n; i++) {
+                mail.command = msg[PLAY_BATCH_HEADER_SIZE + i];
+                mail.seq = (i == n - 1) ? seq : -1;
+                post_mail(sess, &mail);
+            }
+            return PLAY_BATCH_HEADER_SIZE + n;
+        }
+        case OP_CODE_PLAY_SEQ: {
+            if (len < PLAY_SEQ_MSG_SIZE) return 0;
+            mail.command = msg[1];
+            memcpy(&mail.seq, msg + 2, sizeof(int));
+            post_mail(sess, &mail);
+            return PLAY_SEQ_MSG_SIZE;
         }
-        pthread_mutex_unlock(&sess->session_lock);
+        default:
+            debug("Session %d: Unknown opcode %d - ignoring\n", sess->session_id, msg[0]);
+            return 1;
     }
-    return NULL;
 }
 
-// Main loop for a single game session
-void* session_handler(void* arg) {
+/*
+Opens the client's pipes without blocking the loop. The client opens its
+request pipe and then its notification pipe; the request pipe opens at
+once, the notification pipe only once the client opens its end, so it is
+retried for up to CONNECT_TIMEOUT_MS. Both are left non-blocking
+*/
+static int open_session_pipes(session_t *sess) {
+    sess->req_fd = open(sess->cold->req_pipe_path, O_RDONLY | O_NONBLOCK);
+    if (sess->req_fd == -1) return -1;
+    for (int waited = 0; ; waited += CONNECT_RETRY_MS) {
+        sess->notif_fd = open(sess->cold->notif_pipe_path, O_WRONLY | O_NONBLOCK);
+        if (sess->notif_fd != -1) return 0;
+        // ENXIO: nobody has the pipe open for reading yet
+        if (errno != ENXIO || waited >= CONNECT_TIMEOUT_MS) return -1;
+        if (coro_sleep_ms(CONNECT_RETRY_MS) != 0) return -1;
+    }
+}
+
+// Closes a session that ended or never connected and gives its slot back
+static void release_session(session_t *sess) {
+    prof_mutex_lock(LOCK_CLASS_SESSION, &sess->session_lock);
+    int local_id = sess->session_id;
+    record_end(sess);
+    free_session_resources(sess);
+    sess->active = 0;
+    prof_mutex_unlock(&sess->session_lock);
+
+    debug("Session %d ended (Slot freed)\n", local_id);
+}
+
+// Coroutines hand the release to the executor: session_lock and the recorder may block
+static void release_task(void *arg) {
+    release_session(arg);
+}
+
+/*
+Reader of a single game session, a coroutine that suspends while the request
+pipe is empty (until input arrives or the actor wakes it at the end of the
+game). It only parses requests into the actor's mailbox; the actor plays
+them and ticks the ghosts.
+*/
+void session_handler(void* arg) {
     session_t *sess = (session_t*)arg;
     debug("Session %d handler started\n", sess->session_id);
-    
-    if (sess->req_fd == -1 || sess->notif_fd == -1) {
-        debug("Session %d: Pipes not properly opened\n", sess->session_id);
-        pthread_mutex_lock(&sess->session_lock);
-        sess->active = 0;
-        pthread_mutex_unlock(&sess->session_lock);
-        return NULL;
+    sess->reader = coro_self();
+
+    // A level that failed to load still gets its pipes opened: the client waits for them
+    char confirm_msg[2] = { OP_CODE_CONNECT, 0 };
+    if (open_session_pipes(sess) != 0 || !sess->board || write(sess->notif_fd, confirm_msg, 2) != 2) {
+        debug("Session %d: Failed to connect the client\n", sess->session_id);
+        executor_submit(release_task, sess);
+        return;
     }
 
-    pthread_mutex_lock(&sess->session_lock);
+    // The actor is not running yet, the first frame is ours to send
     send_board_update(sess);
-    pthread_mutex_unlock(&sess->session_lock);
-    
-    // The game ends when we stop creating update threads
-    if (pthread_create(&sess->update_thread, NULL, update_sender, sess) != 0) {
-        debug("Session %d: Failed to create update thread\n", sess->session_id);
-        sess->game_active = 0;
-        close(sess->req_fd);
-        close(sess->notif_fd);
-        sess->active = 0;
-        return NULL;
-    }
+    actor_start(sess);
 
-    char buf[256];
+    char buf[PLAY_BATCH_HEADER_SIZE + MAX_BATCH_COMMANDS];
+    int buf_len = 0;
     int keep_running = 1;
-    int update_thread_joined = 0;
-    
-    // Set pipe to non-blocking mode, allowing the server to read without waiting indefinitely
-    int flags = fcntl(sess->req_fd, F_GETFL, 0);
-    fcntl(sess->req_fd, F_SETFL, flags | O_NONBLOCK);
-
-    while (keep_running && server_running) { 
-        pthread_mutex_lock(&sess->session_lock);
-        keep_running = sess->game_active;
-        pthread_mutex_unlock(&sess->session_lock);
-        
-        if (!keep_running) break;
-        
+
+    // Registered for the whole game: input, room in the notification pipe and the
+    // actor's wakes (a full pipe, the end of the game) resume the reader
+    int watching = (coro_watch_fd(sess->req_fd, POLLIN) == 0);
+    if (watching && coro_watch_fd(sess->notif_fd, POLLOUT) != 0) {
+        coro_unwatch_fd(sess->req_fd);
+        watching = 0;
+    }
+    if (!watching) {
+        debug("Session %d: Cannot watch the session pipes\n", sess->session_id);
+        atomic_store(&sess->game_active, 0);
+    }
+
+    while (keep_running && server_running && atomic_load(&sess->game_active)) { 
         // Attempt to read without blocking
-        ssize_t bytes_read = read(sess->req_fd, buf, sizeof(buf));
+        ssize_t bytes_read = read(sess->req_fd, buf + buf_len, sizeof(buf) - buf_len);
         
         if (bytes_read > 0) {
             // Data received - process below
@@ -407,8 +710,15 @@ void* session_handler(void* arg) {
             break;
         } else {
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
-                // No data available yet, sleep briefly to save CPU
-                sleep_ms(50);
+                // The actor's frame did not fit: it writes the rest once the client has read some
+                if (atomic_load(&sess->out_blocked) && pipe_has_room(sess->notif_fd)) {
+                    atomic_store(&sess->out_blocked, 0);
+                    mail_t flush = { .op = MAIL_FLUSH, .command = 0, .seq = -1 };
+                    post_mail(sess, &flush);
+                    actor_notify(sess);
+                }
+                // No data available yet: suspend until input or the end of the game
+                coro_wait();
                 continue;
             } else if (errno == EINTR) {
                 continue;
@@ -418,87 +728,59 @@ void* session_handler(void* arg) {
             }
         }
 
-        // Command Processing
-        pthread_mutex_lock(&sess->session_lock);
-        if (buf[0] == OP_CODE_DISCONNECT) {
-            sess->game_active = 0;
-            char resp[] = { OP_CODE_DISCONNECT, 0 };
-            if (write(sess->notif_fd, resp, 2) == -1) {}
-            pthread_mutex_unlock(&sess->session_lock);
-
-        } else if (buf[0] == OP_CODE_PLAY && sess->board && sess->board->n_pacmans > 0) {
-            command_t cmd = { .command = buf[1], .turns = 1, .turns_left = 1 };
-            board_t *current_board = sess->board;
-            pthread_mutex_unlock(&sess->session_lock);
-            
-            pthread_rwlock_wrlock(&current_board->state_lock);
-            int res = move_pacman(current_board, 0, &cmd);
-            pthread_rwlock_unlock(&current_board->state_lock);
-            
-            if (res == REACHED_PORTAL) {
-                pthread_mutex_lock(&sess->session_lock);
-                sess->game_active = 0;
-                pthread_mutex_unlock(&sess->session_lock);
-                
-                pthread_join(sess->update_thread, NULL);
-                update_thread_joined = 1;
-                
-                // Confirm if level is passed or game ends
-                int move_result = handle_move_result(sess, res);
-                if (move_result == 2) {
-                    update_thread_joined = 0; // New thread started
-                } else if (move_result == 0) {
-                    break;
-                }
-                continue;
-            }
-            
-            // Check if pacman died or game continues
-            int move_result = handle_move_result(sess, res);
-            if (move_result == 1) {
-                pthread_mutex_lock(&sess->session_lock);
-                send_board_update(sess);
-                pthread_mutex_unlock(&sess->session_lock);
-            } else if (move_result == 0) {
-                break;
-            }
-            continue;
-        } else {
-            debug("Session %d: Unknown opcode %d - ignoring\n", sess->session_id, buf[0]);
-            pthread_mutex_unlock(&sess->session_lock);
+        // Command Processing: one read may carry several requests (or half of one)
+        buf_len += bytes_read;
+        int pos = 0;
+        while (keep_running && pos < buf_len) {
+            int consumed = post_request(sess, buf + pos, buf_len - pos, &keep_running);
+            if (consumed == 0) break; // Incomplete request, wait for the rest
+            pos += consumed;
         }
+        memmove(buf, buf + pos, buf_len - pos);
+        buf_len -= pos;
+        actor_notify(sess);
     }
 
-    pthread_mutex_lock(&sess->session_lock);
-    sess->game_active = 0;
-    pthread_mutex_unlock(&sess->session_lock);
-    
-    if (!update_thread_joined) {
-        pthread_join(sess->update_thread, NULL);
+    // A disconnect is acknowledged by the actor: let it drain the mailbox first
+    while (!keep_running && server_running && atomic_load(&sess->game_active)) coro_wait();
+
+    atomic_store(&sess->game_active, 0);
+    actor_stop(sess);
+    if (watching) {
+        coro_unwatch_fd(sess->req_fd);
+        coro_unwatch_fd(sess->notif_fd);
     }
-    free_session_resources(sess);
 
-    int local_id = sess->session_id;
+    // The board is the reader's again
+    executor_submit(release_task, sess);
+}
 
-    pthread_mutex_lock(&sess->session_lock);
-    sess->active = 0; 
-    pthread_mutex_unlock(&sess->session_lock);
-    
-    debug("Session %d ended (Slot freed)\n", local_id);
-    
-    return NULL;
+// Mixes the clock with a counter so concurrent sessions never share a seed (splitmix64)
+static uint64_t new_session_seed(void) {
+    static _Atomic uint64_t counter = 0;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t z = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec + (counter++ * 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
 }
 
 // Manager thread: Picks up requests from the buffer and assigns them to a session
 void* manager_thread(void* arg) {
     int id = *(int*)arg; free(arg);
-    // Block SIGUSR1 in this thread so only the main thread or specific handlers catch it
-    sigset_t mask; sigemptyset(&mask); sigaddset(&mask, SIGUSR1); pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    // Block SIGUSR1/SIGUSR2 in this thread so only the main thread or specific handlers catch them
+    sigset_t mask; sigemptyset(&mask); sigaddset(&mask, SIGUSR1); sigaddset(&mask, SIGUSR2); pthread_sigmask(SIG_BLOCK, &mask, NULL);
     debug("Manager %d started\n", id);
 
     while (server_running) {
         connection_request_t req;
-        if (buffer_remove(&conn_buffer, &req) != 0) {
+        int removed = buffer_remove(&conn_buffer, &req);
+        if (removed == 1) {
+            debug("Manager %d retired (max games lowered)\n", id);
+            break;
+        }
+        if (removed != 0) {
             if (!server_running) break;
             continue;
         }
@@ -510,23 +792,26 @@ void* manager_thread(void* arg) {
 
         int sess_id = -1;
         // Search for an available session slot
-        for (int i = 0; i < max_games; i++) {
-            pthread_mutex_lock(&sessions[i].session_lock);
-            if (!sessions[i].active) {
+        int capacity = atomic_load(&max_games);
+        for (int i = 0; i < capacity; i++) {
+            session_t *slot = session_at(i);
+            prof_mutex_lock(LOCK_CLASS_SESSION, &slot->session_lock);
+            if (!slot->active) {
                 sess_id = i; 
-                sessions[i].active = 1; 
+                slot->active = 1; 
                 
-                sessions[i].session_id = requested_id;
-                sessions[i].game_active = 1; 
-                sessions[i].victory = 0; 
-                sessions[i].current_level = 0;
-                strncpy(sessions[i].req_pipe_path, req.req_pipe_path, MAX_PIPE_PATH_LENGTH);
-                strncpy(sessions[i].notif_pipe_path, req.notif_pipe_path, MAX_PIPE_PATH_LENGTH);
+                slot->session_id = requested_id;
+                slot->game_active = 1; 
+                slot->victory = 0; 
+                slot->points = 0;
+                slot->current_level = 0;
+                strncpy(slot->cold->req_pipe_path, req.req_pipe_path, MAX_PIPE_PATH_LENGTH);
+                strncpy(slot->cold->notif_pipe_path, req.notif_pipe_path, MAX_PIPE_PATH_LENGTH);
                 
-                pthread_mutex_unlock(&sessions[i].session_lock);
+                prof_mutex_unlock(&slot->session_lock);
                 break;
             }
-            pthread_mutex_unlock(&sessions[i].session_lock);
+            prof_mutex_unlock(&slot->session_lock);
         }
 
         if (sess_id == -1) { 
@@ -537,61 +822,131 @@ void* manager_thread(void* arg) {
             continue;
         }
         
-        session_t *sess = &sessions[sess_id];
-        
-        sess->req_fd = open(req.req_pipe_path, O_RDONLY);
-        if (sess->req_fd == -1) {
-            debug("Manager %d: Failed to open req_pipe\n", id);
-            pthread_mutex_lock(&sess->session_lock);
-            sess->active = 0;
-            pthread_mutex_unlock(&sess->session_lock);
-            continue;
-        }
-        
-        sess->notif_fd = open(req.notif_pipe_path, O_WRONLY);
-        if (sess->notif_fd == -1) {
-            debug("Manager %d: Failed to open notif_pipe\n", id);
-            close(sess->req_fd);
-            pthread_mutex_lock(&sess->session_lock);
-            sess->active = 0;
-            pthread_mutex_unlock(&sess->session_lock);
-            continue;
-        }
-        
-        char confirm_msg[2] = { OP_CODE_CONNECT, 0 };
-        if (write(sess->notif_fd, confirm_msg, 2) == -1) {
-            perror("Failed to send confirmation");
-            close(sess->req_fd);
-            close(sess->notif_fd);
-            pthread_mutex_lock(&sess->session_lock);
-            sess->active = 0;
-            pthread_mutex_unlock(&sess->session_lock);
-            continue;
-        }
+        session_t *sess = session_at(sess_id);
+        // Opened by the session's coroutine: a client that never opens its end cannot hold a manager
+        sess->req_fd = sess->notif_fd = -1;
         
+        prof_mutex_lock(LOCK_CLASS_SESSION, &sess->session_lock);
         sess->board = NULL;
+        sess->tick = 0;
+        sess->last_seq = -1;
+        sess->queue_head = sess->queue_len = 0;
+        sess->batch_left = sess->dropped_commands = 0;
+        sess->idle_ticks = 0;
+        sess->last_frame_len = 0;
+        sess->out_len = sess->out_sent = sess->out_stale = 0;
+        atomic_store(&sess->out_blocked, 0);
+        atomic_store(&sess->mail_waiting, 0);
+        ticker_reset_stats(sess);
+        sess->seed = new_session_seed();
+        record_session_start(sess);
+        if (load_next_level(sess) != 0) debug("Manager %d: No level for session %d\n", id, sess->session_id);
+        prof_mutex_unlock(&sess->session_lock);
         
-        pthread_mutex_lock(&sess->session_lock);
-        int level_loaded = (load_next_level(sess) == 0);
-        pthread_mutex_unlock(&sess->session_lock);
-        
-        if (!level_loaded) {
-            close(sess->req_fd);
-            close(sess->notif_fd);
-            pthread_mutex_lock(&sess->session_lock); 
-            sess->active = 0; 
-            pthread_mutex_unlock(&sess->session_lock);
-            continue;
+        // Handover to session logic, the manager goes back to the buffer
+        if (coro_spawn(session_handler, sess) != 0) {
+            debug("Manager %d: Failed to start session %d\n", id, sess->session_id);
+            release_session(sess);
         }
-        
-        // Handover to session logic
-        session_handler(sess);
     }
     debug("Manager %d ended\n", id);
     return NULL;
 }
 
 // Host Thread: Listens on the public FIFO and pushes requests to the buffer
+static int start_managers(int count) {
+    if (n_manager_tids + count > manager_tids_capacity) {
+        int capacity = manager_tids_capacity ? manager_tids_capacity : 16;
+        while (capacity < n_manager_tids + count) capacity *= 2;
+        pthread_t *tids = realloc(manager_tids, capacity * sizeof(pthread_t));
+        if (!tids) return -1;
+        manager_tids = tids;
+        manager_tids_capacity = capacity;
+    }
+    for (int i = 0; i < count; i++) {
+        int *id = malloc(sizeof(int));
+        if (!id) return -1;
+        *id = n_manager_tids;
+        if (pthread_create(&manager_tids[n_manager_tids], NULL, manager_thread, id) != 0) {
+            free(id);
+            return -1;
+        }
+        n_manager_tids++;
+    }
+    return 0;
+}
+
+int resize_sessions(int capacity) {
+    if (capacity <= 0 || capacity > MAX_SESSIONS_LIMIT) return -1;
+    pthread_mutex_lock(&resize_mutex);
+
+    int allocated = atomic_load(&allocated_sessions);
+    while (allocated < capacity) {
+        // Line aligned so no two sessions share a cache line (sizeof(session_t) is a multiple of it)
+        session_segment_t *segment = aligned_alloc(CACHE_LINE_SIZE, sizeof(session_segment_t));
+        if (!segment) break;
+        memset(segment, 0, sizeof(session_segment_t));
+        int ok = 1;
+        for (int i = 0; i < SESSION_SEGMENT_SIZE; i++) {
+            session_t *sess = &segment->sessions[i];
+            sess->req_fd = sess->notif_fd = -1;
+            sess->cold = &segment->cold[i];
+            pthread_mutex_init(&sess->session_lock, NULL);
+            if (ok && board_arena_init(&sess->arena, max_level_cells, max_level_pacmans, max_level_ghosts) != 0) ok = 0;
+            if (ok && !(sess->out_buf = malloc(FRAME_HEADER_MAX + max_level_cells + 2))) ok = 0;
+        }
+        if (!ok) {
+            for (int i = 0; i < SESSION_SEGMENT_SIZE; i++) {
+                pthread_mutex_destroy(&segment->sessions[i].session_lock);
+                board_arena_destroy(&segment->sessions[i].arena);
+                free(segment->sessions[i].out_buf);
+            }
+            free(segment);
+            break;
+        }
+        session_segments[allocated / SESSION_SEGMENT_SIZE] = segment;
+        allocated += SESSION_SEGMENT_SIZE;
+        // Readers load allocated_sessions before touching the new segment
+        atomic_store_explicit(&allocated_sessions, allocated, memory_order_release);
+    }
+    // Every session may be waiting for a tick at once
+    if (allocated < capacity || ticker_reserve(allocated) != 0) {
+        pthread_mutex_unlock(&resize_mutex);
+        return -1;
+    }
+
+    atomic_store(&max_games, capacity);
+    // Extra managers retire once they are idle
+    int spawn = buffer_set_consumers(&conn_buffer, capacity < MAX_MANAGERS ? capacity : MAX_MANAGERS);
+    int result = 0;
+    if (spawn > 0) {
+        int before = n_manager_tids;
+        result = start_managers(spawn);
+        int missing = spawn - (n_manager_tids - before);
+        if (missing > 0) {
+            pthread_mutex_lock(&conn_buffer.mutex);
+            conn_buffer.consumers -= missing;
+            pthread_mutex_unlock(&conn_buffer.mutex);
+        }
+    }
+    debug("Max games is now %d (%d sessions allocated)\n", capacity, allocated);
+    pthread_mutex_unlock(&resize_mutex);
+    return result;
+}
+
+// Admin pipe messages: only the server's user can write them, and growth is capped
+static void handle_admin_message(const char *buf, ssize_t n) {
+    if (buf[0] != OP_CODE_RESIZE || n < ADMIN_MSG_SIZE) return;
+    int capacity;
+    memcpy(&capacity, buf + 1, sizeof(int));
+    debug("Resize req: %d sessions\n", capacity);
+    if (capacity > resize_limit) {
+        debug("Resize to %d sessions refused (limit %d)\n", capacity, resize_limit);
+    } else if (resize_sessions(capacity) != 0) {
+        debug("Resize to %d sessions failed\n", capacity);
+    }
+}
+
 void* host_thread(void* arg) {
     (void)arg;
     debug("Host thread started\n");
@@ -599,14 +954,33 @@ void* host_thread(void* arg) {
     // Open registry pipe in non-blocking mode
     int reg_fd = open(registry_pipe, O_RDWR | O_NONBLOCK);
     if (reg_fd == -1) { debug("Failed to open registry\n"); return NULL; }
+    // Held open for writing too, so it never reads EOF between admin clients
+    int admin_fd = open(admin_pipe, O_RDWR | O_NONBLOCK);
+    if (admin_fd == -1) { debug("Failed to open the admin pipe\n"); close(reg_fd); return NULL; }
 
     while (server_running) {
         if (sigusr1_received) { 
             sigusr1_received = 0; 
             generate_top5_file(); 
         }
+        if (sigusr2_received) {
+            sigusr2_received = 0;
+            if (lockprof_dump("server_stats.txt") != 0 || ticker_dump("server_stats.txt") != 0) {
+                debug("Failed to open server_stats.txt for writing\n");
+            }
+        }
         
-        char buf[1 + MAX_PIPE_PATH_LENGTH * 3];
+        struct pollfd fds[2] = { { .fd = reg_fd, .events = POLLIN }, { .fd = admin_fd, .events = POLLIN } };
+        if (poll(fds, 2, 100) <= 0) continue;
+
+        if (fds[1].revents & POLLIN) {
+            char admin_buf[ADMIN_MSG_SIZE];
+            ssize_t n = read(admin_fd, admin_buf, sizeof(admin_buf));
+            if (n > 0) handle_admin_message(admin_buf, n);
+        }
+        if (!(fds[0].revents & (POLLIN | POLLHUP))) continue;
+
+        char buf[REGISTRY_MSG_SIZE];
         ssize_t n = read(reg_fd, buf, sizeof(buf));
         
         if (n <= 0) {
@@ -634,6 +1008,7 @@ void* host_thread(void* arg) {
         }
     }
     close(reg_fd);
+    close(admin_fd);
     debug("Host thread ended\n");
     return NULL;
 }
@@ -649,17 +1024,47 @@ void signal_handler(int signum) {
         if (write(shutdown_pipe[1], &c, 1) == -1) {} 
     } else if (signum == SIGUSR1) {
         sigusr1_received = 1;
+    } else if (signum == SIGUSR2) {
+        sigusr2_received = 1;
+    }
+}
+
+// Parses the optional flags that follow the positional arguments
+static int parse_server_options(int argc, char** argv) {
+    for (int i = 4; i < argc; i++) {
+        if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            checkpoint_interval_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--checkpoint-file") == 0 && i + 1 < argc) {
+            strncpy(checkpoint_file, argv[++i], sizeof(checkpoint_file) - 1);
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            strncpy(record_file, argv[++i], sizeof(record_file) - 1);
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            executor_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--loops") == 0 && i + 1 < argc) {
+            coro_loops = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--tick-catchup") == 0 && i + 1 < argc) {
+            tick_catchup_max = atoi(argv[++i]);
+            if (tick_catchup_max < 0) return -1;
+        } else {
+            return -1;
+        }
     }
+    return 0;
 }
 
 int main(int argc, char** argv) {
-    if (argc != 4) { fprintf(stderr, "Usage: %s <levels> <max_games> <fifo>\n", argv[0]); return 1; }
+    if (argc < 4 || parse_server_options(argc, argv) != 0) {
+        fprintf(stderr, "Usage: %s <levels> <max_games> <fifo> [--checkpoint <ms>] [--checkpoint-file <path>] [--record <file>] [--workers <n>] [--loops <n>] [--tick-catchup <n>]\n", argv[0]);
+        return 1;
+    }
     
-    max_games = atoi(argv[2]);
-    if (max_games <= 0) return 1;
+    int initial_games = atoi(argv[2]);
+    if (initial_games <= 0 || initial_games > MAX_SESSIONS_LIMIT) return 1;
 
     strncpy(levels_dir, argv[1], 255); 
     strncpy(registry_pipe, argv[3], MAX_PIPE_PATH_LENGTH-1);
+    snprintf(admin_pipe, sizeof(admin_pipe), "%s%s", registry_pipe, ADMIN_PIPE_SUFFIX);
+    resize_limit = initial_games > MAX_SESSIONS_LIMIT / RESIZE_GROWTH_MAX ? MAX_SESSIONS_LIMIT : initial_games * RESIZE_GROWTH_MAX;
     
     // Initialize level cache
     init_level_cache(levels_dir);
@@ -667,21 +1072,20 @@ int main(int argc, char** argv) {
     if (pipe(shutdown_pipe) == -1) return 1;
 
     open_debug_file("server_debug.log");
-    debug("Starting server. Max games: %d. Levels cached: %d\n", max_games, cached_num_levels);
-
-    sessions = calloc(max_games, sizeof(session_t));
-    if (!sessions) { fprintf(stderr, "Failed to allocate sessions\n"); return 1; }
+    debug("Starting server. Max games: %d. Levels cached: %d\n", initial_games, cached_num_levels);
 
-    // Initialize mutex for each session
-    for(int i=0; i<max_games; i++) { 
-        sessions[i].req_fd = sessions[i].notif_fd = -1; 
-        pthread_mutex_init(&sessions[i].session_lock, NULL); 
+    if (record_file[0] != '\0' && recorder_open(record_file) != 0) {
+        fprintf(stderr, "Failed to open recording file %s\n", record_file);
+        return 1;
     }
-    
+
     init_connection_buffer(&conn_buffer);
     
     unlink(registry_pipe); 
     if (mkfifo(registry_pipe, 0666) == -1) { perror("mkfifo"); return 1; }
+    // Resizes allocate memory, so only the server's user may ask for them
+    unlink(admin_pipe);
+    if (mkfifo(admin_pipe, 0600) == -1) { perror("mkfifo"); return 1; }
 
     struct sigaction sa_int, sa_usr1;
     
@@ -695,24 +1099,32 @@ int main(int argc, char** argv) {
     sigemptyset(&sa_usr1.sa_mask);
     sa_usr1.sa_flags = SA_RESTART;
     sigaction(SIGUSR1, &sa_usr1, NULL);
+    // SIGUSR2 dumps the lock profile and the tick jitter to server_stats.txt
+    sigaction(SIGUSR2, &sa_usr1, NULL);
     
     signal(SIGPIPE, SIG_IGN); 
 
-    pthread_t host_tid, *mgr_tids = malloc(max_games * sizeof(pthread_t));
-    if (!mgr_tids) { free(sessions); return 1; }
-    
-    if (pthread_create(&host_tid, NULL, host_thread, NULL) != 0) {
-        free(mgr_tids); free(sessions); return 1;
+    // Ghost ticks of every session run on the executor, paced by the ticker
+    if (executor_start(executor_threads) != 0 || ticker_start() != 0 || coro_runtime_start(coro_loops) != 0) {
+        fprintf(stderr, "Failed to start the executor\n");
+        return 1;
     }
-    
-    for(int i=0; i<max_games; i++) {
-        int *id = malloc(sizeof(int));
-        if (id) {
-            *id = i;
-            if (pthread_create(&mgr_tids[i], NULL, manager_thread, id) != 0) free(id);
-        }
+
+    // Allocates the sessions and starts their managers, later resizes come through the admin pipe
+    if (resize_sessions(initial_games) != 0) {
+        fprintf(stderr, "Failed to allocate sessions\n");
+        return 1;
     }
 
+    pthread_t host_tid;
+    if (pthread_create(&host_tid, NULL, host_thread, NULL) != 0) return 1;
+    
+    pthread_t checkpoint_tid;
+    int checkpoint_running = 0;
+    if (checkpoint_interval_ms > 0) {
+        checkpoint_running = (pthread_create(&checkpoint_tid, NULL, checkpoint_thread, NULL) == 0);
+    }
+    
     debug("Server running...\n");
     
     while(server_running) sleep(1); 
@@ -725,21 +1137,34 @@ int main(int argc, char** argv) {
     if(dummy != -1) close(dummy);
  
     pthread_join(host_tid, NULL); 
-    for(int i=0; i<max_games; i++) pthread_join(mgr_tids[i], NULL);
-    free(mgr_tids);
+    if (checkpoint_running) pthread_join(checkpoint_tid, NULL);
+    // The host thread was the only one resizing, so the list is final
+    for(int i=0; i<n_manager_tids; i++) pthread_join(manager_tids[i], NULL);
+    free(manager_tids);
+    // Session coroutines see server_running and end, disarming their ticks
+    coro_runtime_stop();
+    // The last ticks drain before the workers exit
+    ticker_stop();
+    executor_stop();
 
     cleanup_connection_resources(&conn_buffer);
 
-    for(int i=0; i<max_games; i++) {
-        pthread_mutex_lock(&sessions[i].session_lock);
-        if(sessions[i].active) free_session_resources(&sessions[i]);
-        pthread_mutex_unlock(&sessions[i].session_lock);
-        pthread_mutex_destroy(&sessions[i].session_lock);
+    int n_sessions = atomic_load(&allocated_sessions);
+    for(int i=0; i<n_sessions; i++) {
+        session_t *sess = session_at(i);
+        prof_mutex_lock(LOCK_CLASS_SESSION, &sess->session_lock);
+        if(sess->active) free_session_resources(sess);
+        prof_mutex_unlock(&sess->session_lock);
+        pthread_mutex_destroy(&sess->session_lock);
+        board_arena_destroy(&sess->arena);
+        free(sess->out_buf);
     }
-    
-    free(sessions);
+    for(int i=0; i<n_sessions / SESSION_SEGMENT_SIZE; i++) free(session_segments[i]);
+    for (int i = 0; i < cached_num_levels; i++) level_release(cached_levels[i]);
+    recorder_close();
     close(shutdown_pipe[0]); close(shutdown_pipe[1]); 
     unlink(registry_pipe);
+    unlink(admin_pipe);
     close_debug_file();
     
     return 0;
@@ -0,0 +1,358 @@
+#include "ticker.h"
+#include "executor.h"
+#include "actor.h"
+#include "debug.h"
+#include "lockprof.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <time.h>
+
+int tick_catchup_max = TICK_CATCHUP_DEFAULT;
+
+typedef struct tick_batch {
+    struct tick_batch *next;        // Free list link
+    int n;
+    session_t *sessions[TICK_BATCH_MAX];
+} tick_batch_t;
+
+typedef struct {
+    uint64_t deadline;              // tick_deadline when the session was queued
+    session_t *sess;
+} tick_entry_t;
+
+static pthread_t ticker_tid;
+static int ticker_started = 0;
+static int ticker_running = 0;
+static int rescan = 0;              // An earlier deadline was queued while the ticker slept
+static uint64_t sleeping_until = 0; // Deadline the ticker waits for (0 while it is awake)
+// Guards the heap and the flags above, wakes the ticker when an earlier tick is queued
+static pthread_mutex_t ticker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ticker_cond;
+
+// Min-heap on the deadline, sess->tick_slot is the entry's position + 1
+static tick_entry_t *heap = NULL;
+static int heap_len = 0, heap_capacity = 0;
+
+// Batches are recycled, so a steady tick rate does not allocate
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static tick_batch_t *free_batches = NULL;
+static _Atomic int batches_out = 0;  // Handed to tasks and not yet returned
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static tick_batch_t *batch_get(void) {
+    pthread_mutex_lock(&pool_mutex);
+    tick_batch_t *batch = free_batches;
+    if (batch) free_batches = batch->next;
+    pthread_mutex_unlock(&pool_mutex);
+    if (!batch) batch = malloc(sizeof(tick_batch_t));
+    if (batch) {
+        batch->n = 0;
+        atomic_fetch_add(&batches_out, 1);
+    }
+    return batch;
+}
+
+static void batch_put(tick_batch_t *batch) {
+    pthread_mutex_lock(&pool_mutex);
+    batch->next = free_batches;
+    free_batches = batch;
+    pthread_mutex_unlock(&pool_mutex);
+    atomic_fetch_sub(&batches_out, 1);
+}
+
+// Executor task: one step of each claimed actor of the batch, in table order
+static void run_tick_batch(void *arg) {
+    tick_batch_t *batch = arg;
+    for (int i = 0; i < batch->n; i++) actor_run(batch->sessions[i]);
+    batch_put(batch);
+}
+
+static void submit_batch(tick_batch_t **batch, int *cells) {
+    if (*batch && (*batch)->n > 0) executor_submit(run_tick_batch, *batch);
+    else if (*batch) batch_put(*batch);
+    *batch = NULL;
+    *cells = 0;
+}
+
+// ==========================================
+// Heap (under ticker_mutex)
+
+static void heap_set(int i, tick_entry_t entry) {
+    heap[i] = entry;
+    entry.sess->tick_slot = i + 1;
+}
+
+static void heap_up(int i) {
+    tick_entry_t entry = heap[i];
+    while (i > 0 && heap[(i - 1) / 2].deadline > entry.deadline) {
+        heap_set(i, heap[(i - 1) / 2]);
+        i = (i - 1) / 2;
+    }
+    heap_set(i, entry);
+}
+
+static void heap_down(int i) {
+    tick_entry_t entry = heap[i];
+    for (;;) {
+        int child = 2 * i + 1;
+        if (child >= heap_len) break;
+        if (child + 1 < heap_len && heap[child + 1].deadline < heap[child].deadline) child++;
+        if (heap[child].deadline >= entry.deadline) break;
+        heap_set(i, heap[child]);
+        i = child;
+    }
+    heap_set(i, entry);
+}
+
+static void heap_remove(session_t *sess) {
+    int i = sess->tick_slot - 1;
+    if (i < 0) return;
+    sess->tick_slot = 0;
+    tick_entry_t last = heap[--heap_len];
+    if (i == heap_len) return;
+    heap_set(i, last);
+    heap_up(i);
+    heap_down(last.sess->tick_slot - 1);
+}
+
+// ==========================================
+// Ticker thread
+
+// Claims the due sessions taken off the heap and hands them to the executor
+static void submit_due_ticks(session_t **due, int n_due) {
+    tick_batch_t *batch = NULL;
+    int batch_cells = 0;
+
+    for (int i = 0; i < n_due; i++) {
+        session_t *sess = due[i];
+        // Running or parked: whoever holds it queues it again when it becomes idle (stopped: dropped)
+        if (!actor_claim(sess)) continue;
+
+        int cells = sess->tick_cells;
+        if (cells > TICK_BATCH_CELLS) {
+            // Large board: a task of its own, so another worker can steal it
+            tick_batch_t *alone = batch_get();
+            if (!alone) { actor_run(sess); continue; }
+            alone->sessions[alone->n++] = sess;
+            executor_submit(run_tick_batch, alone);
+            continue;
+        }
+        if (batch && (batch->n == TICK_BATCH_MAX || batch_cells + cells > TICK_BATCH_CELLS)) {
+            submit_batch(&batch, &batch_cells);
+        }
+        if (!batch) batch = batch_get();
+        // Out of memory: step it on the ticker rather than losing the claim
+        if (!batch) { actor_run(sess); continue; }
+        batch->sessions[batch->n++] = sess;
+        batch_cells += cells;
+    }
+    submit_batch(&batch, &batch_cells);
+}
+
+static void* ticker_main(void* arg) {
+    (void)arg;
+    sigset_t mask; sigemptyset(&mask); sigaddset(&mask, SIGUSR1); sigaddset(&mask, SIGUSR2); pthread_sigmask(SIG_BLOCK, &mask, NULL);
+    debug("Ticker started\n");
+
+    session_t *due[TICK_DUE_CHUNK];
+    pthread_mutex_lock(&ticker_mutex);
+    while (ticker_running) {
+        uint64_t now = now_ns();
+        int n_due = 0;
+        while (heap_len > 0 && heap[0].deadline <= now && n_due < TICK_DUE_CHUNK) {
+            due[n_due++] = heap[0].sess;
+            heap_remove(heap[0].sess);
+        }
+        if (n_due > 0) {
+            // Submitted unlocked: a full executor runs tasks inline, and they queue their sessions again
+            pthread_mutex_unlock(&ticker_mutex);
+            submit_due_ticks(due, n_due);
+            pthread_mutex_lock(&ticker_mutex);
+            continue;
+        }
+
+        uint64_t next = now + (uint64_t)TICKER_IDLE_MS * 1000000ULL;
+        if (heap_len > 0 && heap[0].deadline < next) next = heap[0].deadline;
+        struct timespec until = { .tv_sec = next / 1000000000ULL, .tv_nsec = next % 1000000000ULL };
+        rescan = 0;
+        sleeping_until = next;
+        while (!rescan && ticker_running && pthread_cond_timedwait(&ticker_cond, &ticker_mutex, &until) == 0);
+        sleeping_until = 0;
+    }
+    pthread_mutex_unlock(&ticker_mutex);
+
+    debug("Ticker ended\n");
+    return NULL;
+}
+
+int ticker_start(void) {
+    // Deadlines are CLOCK_MONOTONIC, so the condition waits on it as well
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&ticker_cond, &attr);
+    pthread_condattr_destroy(&attr);
+
+    ticker_running = 1;
+    if (pthread_create(&ticker_tid, NULL, ticker_main, NULL) != 0) {
+        ticker_running = 0;
+        pthread_cond_destroy(&ticker_cond);
+        return -1;
+    }
+    ticker_started = 1;
+    return 0;
+}
+
+void ticker_stop(void) {
+    if (!ticker_started) return;
+    pthread_mutex_lock(&ticker_mutex);
+    ticker_running = 0;
+    pthread_cond_signal(&ticker_cond);
+    pthread_mutex_unlock(&ticker_mutex);
+    pthread_join(ticker_tid, NULL);
+    pthread_cond_destroy(&ticker_cond);
+    ticker_started = 0;
+    for (int i = 0; i < heap_len; i++) heap[i].sess->tick_slot = 0;
+    free(heap);
+    heap = NULL;
+    heap_len = heap_capacity = 0;
+
+    // Tasks already submitted return their batches to the pool
+    while (atomic_load(&batches_out) > 0) sleep_ms(1);
+    pthread_mutex_lock(&pool_mutex);
+    while (free_batches) {
+        tick_batch_t *batch = free_batches;
+        free_batches = batch->next;
+        free(batch);
+    }
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+void ticker_arm(session_t *sess) {
+    if (!sess->board) return;
+    // A tempo of 0 would make every tick due at once
+    sess->tick_interval_ms = sess->board->tempo > 0 ? sess->board->tempo : 1;
+    sess->tick_cells = sess->board->width * sess->board->height;
+    atomic_store_explicit(&sess->tick_deadline, now_ns() + (uint64_t)sess->tick_interval_ms * 1000000ULL, memory_order_relaxed);
+}
+
+int ticker_reserve(int sessions) {
+    pthread_mutex_lock(&ticker_mutex);
+    int result = 0;
+    if (sessions > heap_capacity) {
+        tick_entry_t *grown = realloc(heap, sessions * sizeof(tick_entry_t));
+        if (grown) {
+            heap = grown;
+            heap_capacity = sessions;
+        } else {
+            result = -1;
+        }
+    }
+    pthread_mutex_unlock(&ticker_mutex);
+    return result;
+}
+
+void ticker_schedule(session_t *sess) {
+    uint64_t deadline = atomic_load_explicit(&sess->tick_deadline, memory_order_relaxed);
+    pthread_mutex_lock(&ticker_mutex);
+    if (deadline == UINT64_MAX) {
+        heap_remove(sess);
+    } else if (sess->tick_slot > 0) {
+        int i = sess->tick_slot - 1;
+        heap[i].deadline = deadline;
+        heap_up(i);
+        heap_down(sess->tick_slot - 1);
+    } else if (heap_len < heap_capacity) {
+        heap_set(heap_len, (tick_entry_t){ deadline, sess });
+        heap_up(heap_len++);
+    }
+    // Only a sleeping ticker can miss it, an awake one looks at the heap before it sleeps
+    if (deadline < sleeping_until) {
+        rescan = 1;
+        pthread_cond_signal(&ticker_cond);
+    }
+    pthread_mutex_unlock(&ticker_mutex);
+}
+
+void ticker_unschedule(session_t *sess) {
+    pthread_mutex_lock(&ticker_mutex);
+    heap_remove(sess);
+    pthread_mutex_unlock(&ticker_mutex);
+}
+
+void ticker_advance(session_t *sess, uint64_t now) {
+    uint64_t deadline = atomic_load_explicit(&sess->tick_deadline, memory_order_relaxed);
+    uint64_t interval = (uint64_t)sess->tick_interval_ms * 1000000ULL;
+    uint64_t late = now > deadline ? now - deadline : 0;
+
+    // Only the actor writes these, the dump reads them while the game runs
+    tick_stats_t *st = &sess->tick_stats;
+    atomic_store_explicit(&st->ticks, atomic_load_explicit(&st->ticks, memory_order_relaxed) + 1, memory_order_relaxed);
+    atomic_store_explicit(&st->late_total_ns, atomic_load_explicit(&st->late_total_ns, memory_order_relaxed) + late, memory_order_relaxed);
+    if (late > atomic_load_explicit(&st->late_max_ns, memory_order_relaxed)) {
+        atomic_store_explicit(&st->late_max_ns, late, memory_order_relaxed);
+    }
+    atomic_store_explicit(&st->late_last_ns, late, memory_order_relaxed);
+
+    // Whole ticks missed besides this one
+    uint64_t behind = late / interval;
+    if (behind > (uint64_t)tick_catchup_max) {
+        deadline += behind * interval;
+        atomic_store_explicit(&st->skipped, atomic_load_explicit(&st->skipped, memory_order_relaxed) + behind, memory_order_relaxed);
+    }
+    atomic_store_explicit(&sess->tick_deadline, deadline + interval, memory_order_relaxed);
+}
+
+void ticker_reset_stats(session_t *sess) {
+    atomic_store_explicit(&sess->tick_stats.ticks, 0, memory_order_relaxed);
+    atomic_store_explicit(&sess->tick_stats.late_total_ns, 0, memory_order_relaxed);
+    atomic_store_explicit(&sess->tick_stats.late_max_ns, 0, memory_order_relaxed);
+    atomic_store_explicit(&sess->tick_stats.late_last_ns, 0, memory_order_relaxed);
+    atomic_store_explicit(&sess->tick_stats.skipped, 0, memory_order_relaxed);
+}
+
+int ticker_dump(const char *path) {
+    FILE *f = fopen(path, "a");
+    if (!f) return -1;
+
+    fprintf(f, "\nTick jitter (late = start of the tick - its deadline, catch-up %d)\n================================\n\n", tick_catchup_max);
+    fprintf(f, "%-8s %10s %12s %12s %13s %10s\n", "session", "ticks", "late_avg_us", "late_max_us", "late_last_us", "skipped");
+
+    uint64_t all_ticks = 0, all_late = 0, all_max = 0, all_skipped = 0;
+    int n_sessions = atomic_load(&allocated_sessions);
+    for (int i = 0; i < n_sessions; i++) {
+        session_t *sess = session_at(i);
+        prof_mutex_lock(LOCK_CLASS_SESSION, &sess->session_lock);
+        int id = sess->active ? sess->session_id : -1;
+        prof_mutex_unlock(&sess->session_lock);
+        if (id == -1) continue;
+
+        tick_stats_t *st = &sess->tick_stats;
+        uint64_t ticks = atomic_load_explicit(&st->ticks, memory_order_relaxed);
+        uint64_t late = atomic_load_explicit(&st->late_total_ns, memory_order_relaxed);
+        uint64_t max = atomic_load_explicit(&st->late_max_ns, memory_order_relaxed);
+        uint64_t last = atomic_load_explicit(&st->late_last_ns, memory_order_relaxed);
+        uint64_t skipped = atomic_load_explicit(&st->skipped, memory_order_relaxed);
+        fprintf(f, "%-8d %10llu %12llu %12llu %13llu %10llu\n", id, (unsigned long long)ticks,
+                (unsigned long long)(ticks ? late / ticks / 1000 : 0), (unsigned long long)(max / 1000),
+                (unsigned long long)(last / 1000), (unsigned long long)skipped);
+
+        all_ticks += ticks;
+        all_late += late;
+        if (max > all_max) all_max = max;
+        all_skipped += skipped;
+    }
+    fprintf(f, "%-8s %10llu %12llu %12llu %13s %10llu\n", "all", (unsigned long long)all_ticks,
+            (unsigned long long)(all_ticks ? all_late / all_ticks / 1000 : 0), (unsigned long long)(all_max / 1000),
+            "", (unsigned long long)all_skipped);
+
+    fclose(f);
+    return 0;
+}
@@ -0,0 +1,313 @@
+#include "board.h"
+#include "parser.h"
+#include "simulation.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+
+/*
+Offline level analyzer. Every .lvl file of a directory is loaded with the
+game parser and checked for:
+  - dots and portals the pacman cannot reach from its start (BFS, walls block)
+  - the shortest path from the start to a portal
+  - the outcome of the level's .p script against the scripted ghosts:
+    the level is played with the headless game's ticks (savepoints included)
+    until the pacman wins, dies with no save left or the whole board state
+    repeats (then the script can never win)
+Levels are analyzed concurrently by a pool of worker threads.
+*/
+
+#define DEFAULT_MAX_TICKS 200000
+
+typedef enum {
+    SCRIPT_NONE,     // No pacman moves in the .p file
+    SCRIPT_WON,
+    SCRIPT_DIED,     // Died with no savepoint to go back to
+    SCRIPT_QUIT,
+    SCRIPT_LOOPS,    // Board state repeated: the level is unwinnable with this script
+    SCRIPT_TIMEOUT,  // Neither outcome nor repetition within max_ticks ('R' moves never repeat)
+} script_outcome_t;
+
+typedef struct {
+    const char *level;
+    int loaded;
+    int dots, unreachable_dots;
+    int portals, unreachable_portals;
+    int portal_distance;     // -1 when no portal is reachable
+    script_outcome_t outcome;
+    int ticks;               // Tick of the outcome (a tick inside the cycle for SCRIPT_LOOPS)
+    int period;              // Length of the cycle for SCRIPT_LOOPS
+    int points;
+} level_report_t;
+
+typedef struct {
+    char *dirname;
+    level_report_t *reports;
+    int max_ticks;
+} analyzer_t;
+
+// ==========================================
+// Reachability
+
+static void analyze_reachability(board_t *board, level_report_t *report) {
+    int cells = board->width * board->height;
+    int *dist = malloc(cells * sizeof(int));
+    int *queue = malloc(cells * sizeof(int));
+    for (int i = 0; i < cells; i++) dist[i] = -1;
+
+    // Ghosts move, so only walls block the pacman
+    int head = 0, tail = 0;
+    pacman_t *pac = &board->pacmans[0];
+    int start = pac->pos_y * board->width + pac->pos_x;
+    if (start >= 0 && start < cells) {
+        dist[start] = 0;
+        queue[tail++] = start;
+    }
+    while (head < tail) {
+        int idx = queue[head++];
+        int x = idx % board->width, y = idx / board->width;
+        int nx[4] = { x, x, x - 1, x + 1 };
+        int ny[4] = { y - 1, y + 1, y, y };
+        for (int d = 0; d < 4; d++) {
+            if (nx[d] < 0 || nx[d] >= board->width || ny[d] < 0 || ny[d] >= board->height) continue;
+            int next = ny[d] * board->width + nx[d];
+            if (dist[next] != -1 || board->board[next].content == 'W') continue;
+            dist[next] = dist[idx] + 1;
+            // The pacman leaves the board through the first portal it steps on
+            if (!board->board[next].has_portal) queue[tail++] = next;
+        }
+    }
+
+    report->portal_distance = -1;
+    for (int i = 0; i < cells; i++) {
+        board_pos_t *cell = &board->board[i];
+        if (cell->has_dot) {
+            report->dots++;
+            if (dist[i] == -1) report->unreachable_dots++;
+        }
+        if (cell->has_portal) {
+            report->portals++;
+            if (dist[i] == -1) report->unreachable_portals++;
+            else if (report->portal_distance == -1 || dist[i] < report->portal_distance) report->portal_distance = dist[i];
+        }
+    }
+
+    free(dist);
+    free(queue);
+}
+
+// ==========================================
+// Script simulation with cycle detection (Brent): the state saved at each
+// power of two is compared with every later tick
+
+typedef struct {
+    char *cells;        // content, has_dot, has_portal per cell
+    pacman_t *pacmans;
+    ghost_t *ghosts;
+    uint64_t rng;
+} board_state_t;
+
+static void state_alloc(board_state_t *state, board_t *board) {
+    state->cells = malloc(board->width * board->height * 3);
+    state->pacmans = malloc(board->n_pacmans * sizeof(pacman_t));
+    state->ghosts = malloc((board->n_ghosts > 0 ? board->n_ghosts : 1) * sizeof(ghost_t));
+}
+
+static void state_free(board_state_t *state) {
+    free(state->cells);
+    free(state->pacmans);
+    free(state->ghosts);
+}
+
+// Copies everything that decides the next ticks into scratch
+static void state_capture(board_state_t *scratch, board_t *board) {
+    int cells = board->width * board->height;
+    for (int i = 0; i < cells; i++) {
+        scratch->cells[3 * i] = board->board[i].content;
+        scratch->cells[3 * i + 1] = (char)board->board[i].has_dot;
+        scratch->cells[3 * i + 2] = (char)board->board[i].has_portal;
+    }
+    // current_move only grows, the scripts use it modulo n_moves
+    memcpy(scratch->pacmans, board->pacmans, board->n_pacmans * sizeof(pacman_t));
+    for (int i = 0; i < board->n_pacmans; i++) {
+        if (scratch->pacmans[i].n_moves > 0) scratch->pacmans[i].current_move %= scratch->pacmans[i].n_moves;
+    }
+    memcpy(scratch->ghosts, board->ghosts, board->n_ghosts * sizeof(ghost_t));
+    for (int i = 0; i < board->n_ghosts; i++) {
+        if (scratch->ghosts[i].n_moves > 0) scratch->ghosts[i].current_move %= scratch->ghosts[i].n_moves;
+    }
+    scratch->rng = board->rng_state;
+}
+
+static int state_equal(board_state_t *a, board_state_t *b, board_t *board) {
+    return a->rng == b->rng &&
+           memcmp(a->cells, b->cells, board->width * board->height * 3) == 0 &&
+           memcmp(a->pacmans, b->pacmans, board->n_pacmans * sizeof(pacman_t)) == 0 &&
+           memcmp(a->ghosts, b->ghosts, board->n_ghosts * sizeof(ghost_t)) == 0;
+}
+
+static void analyze_script(board_t *board, level_report_t *report, int max_ticks) {
+    pacman_t *pac = &board->pacmans[0];
+    if (pac->n_moves == 0) {
+        report->outcome = SCRIPT_NONE;
+        return;
+    }
+
+    save_ring_t saves = {0};
+    if (save_ring_reset(&saves, board) != 0) {
+        save_ring_free(&saves);
+        report->outcome = SCRIPT_TIMEOUT;
+        return;
+    }
+
+    board_state_t saved, current;
+    state_alloc(&saved, board);
+    state_alloc(&current, board);
+    state_capture(&saved, board);
+    int saved_tick = 0, power = 1;
+
+    report->outcome = SCRIPT_TIMEOUT;
+    int tick = 0;
+    while (tick < max_ticks) {
+        int ring_head = saves.head, ring_count = saves.count;
+        int result = simulation_step(board, &saves);
+        tick++;
+
+        if (result == QUIT_GAME) {
+            report->outcome = SCRIPT_QUIT;
+            break;
+        }
+        if (result == NEXT_LEVEL) {
+            report->outcome = SCRIPT_WON;
+            break;
+        }
+        if (result == LOAD_BACKUP) {
+            report->outcome = SCRIPT_DIED;
+            break;
+        }
+
+        state_capture(&current, board);
+        if (saves.head != ring_head || saves.count != ring_count) {
+            // The savepoints are part of the state too: look for a cycle from here on
+            board_state_t swap = saved;
+            saved = current;
+            current = swap;
+            saved_tick = tick;
+            power = 1;
+            continue;
+        }
+        if (state_equal(&current, &saved, board)) {
+            report->outcome = SCRIPT_LOOPS;
+            report->period = tick - saved_tick;
+            tick = saved_tick;
+            break;
+        }
+        if (tick - saved_tick == power) {
+            board_state_t swap = saved;
+            saved = current;
+            current = swap;
+            saved_tick = tick;
+            power *= 2;
+        }
+    }
+    report->ticks = tick;
+    report->points = pac->points;
+
+    state_free(&saved);
+    state_free(&current);
+    save_ring_free(&saves);
+}
+
+static void analyze_level(analyzer_t *analyzer, level_report_t *report) {
+    board_t board;
+    if (load_level(&board, (char*)report->level, analyzer->dirname, 0) != 0) return;
+    report->loaded = 1;
+    read_pacman_moves(&board);
+
+    analyze_reachability(&board, report);
+    analyze_script(&board, report, analyzer->max_ticks);
+
+    unload_level(&board);
+}
+
+static void analyzer_job(void *ctx, int index) {
+    analyzer_t *analyzer = (analyzer_t*) ctx;
+    analyze_level(analyzer, &analyzer->reports[index]);
+}
+
+// ==========================================
+// Report
+
+// Returns 1 when the level has a problem worth failing a check for
+static int print_report(level_report_t *report) {
+    if (!report->loaded) {
+        printf("%s: FAILED TO LOAD\n", report->level);
+        return 1;
+    }
+
+    int bad = report->portals == 0 || report->portal_distance == -1 || report->unreachable_dots > 0 ||
+              report->outcome == SCRIPT_DIED || report->outcome == SCRIPT_LOOPS;
+
+    printf("%s: %s\n", report->level, bad ? "PROBLEMS" : "ok");
+    printf("  dots: %d (%d unreachable)\n", report->dots, report->unreachable_dots);
+    printf("  portals: %d (%d unreachable)\n", report->portals, report->unreachable_portals);
+    if (report->portal_distance >= 0) printf("  shortest path to portal: %d moves\n", report->portal_distance);
+    else printf("  shortest path to portal: none\n");
+
+    switch (report->outcome) {
+        case SCRIPT_NONE: printf("  script: no pacman moves\n"); break;
+        case SCRIPT_WON: printf("  script: wins at tick %d with %d points\n", report->ticks, report->points); break;
+        case SCRIPT_DIED: printf("  script: dies at tick %d with %d points\n", report->ticks, report->points); break;
+        case SCRIPT_QUIT: printf("  script: quits at tick %d\n", report->ticks); break;
+        case SCRIPT_LOOPS:
+            printf("  script: unwinnable, by tick %d the board repeats every %d ticks\n", report->ticks, report->period);
+            break;
+        case SCRIPT_TIMEOUT: printf("  script: no outcome after %d ticks\n", report->ticks); break;
+    }
+    return bad;
+}
+
+int main(int argc, char** argv) {
+    int jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    int max_ticks = DEFAULT_MAX_TICKS;
+    int bad_args = argc < 2;
+    for (int i = 2; i < argc && !bad_args; i++) {
+        if (strcmp(argv[i], "--jobs") == 0 && i + 1 < argc) jobs = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--max-ticks") == 0 && i + 1 < argc) max_ticks = atoi(argv[++i]);
+        else bad_args = 1;
+    }
+    if (bad_args || jobs < 1 || max_ticks < 1) {
+        fprintf(stderr, "Usage: %s <level_directory> [--jobs N] [--max-ticks N]\n", argv[0]);
+        return 1;
+    }
+
+    // Engine debug output is not interesting here
+    open_debug_file("/dev/null");
+
+    char **levels;
+    int n_levels = list_level_files(argv[1], &levels);
+    if (n_levels < 0) {
+        fprintf(stderr, "Failed to open directory: %s\n", argv[1]);
+        close_debug_file();
+        return 1;
+    }
+
+    analyzer_t analyzer = { .dirname = argv[1], .max_ticks = max_ticks };
+    analyzer.reports = calloc(n_levels > 0 ? n_levels : 1, sizeof(level_report_t));
+    for (int i = 0; i < n_levels; i++) analyzer.reports[i].level = levels[i];
+
+    run_jobs(n_levels, jobs, analyzer_job, &analyzer);
+
+    int n_bad = 0;
+    for (int i = 0; i < n_levels; i++) {
+        n_bad += print_report(&analyzer.reports[i]);
+    }
+    printf("%d levels analyzed, %d with problems\n", n_levels, n_bad);
+
+    free(analyzer.reports);
+    free_level_files(levels, n_levels);
+    close_debug_file();
+    return n_bad > 0 ? 2 : 0;
+}
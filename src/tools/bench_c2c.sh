@@ -0,0 +1,46 @@
+#!/bin/sh
+# Cache line contention benchmark: runs bin/pacman_load against the server
+# under perf c2c and prints the HITM counts (loads served from a line another
+# core had modified). Lines bouncing between the session table's readers and
+# actors show up as HITMs, so comparing two builds of the server shows
+# whether the hot/cold split of session_t removed them:
+#
+#   make rebuild SANITIZE= && make bench-c2c
+#   SERVER=/path/to/baseline/bin/PacmanIST sh src/tools/bench_c2c.sh
+#
+# ThreadSanitizer adds its own shadow memory traffic, measure plain builds.
+# perf c2c needs load sampling (Intel PEBS or AMD IBS) and perf_event access.
+set -eu
+
+SERVER=${SERVER:-bin/PacmanIST}
+LOAD=${LOAD:-bin/pacman_load}
+LEVELS=${LEVELS:-levels}
+CLIENTS=${CLIENTS:-64}
+DURATION=${DURATION:-10}
+OUT=${OUT:-c2c}
+
+if ! command -v perf >/dev/null 2>&1; then
+    echo "perf not found" >&2
+    exit 1
+fi
+
+fifo=$(mktemp -u /tmp/bench_c2c_XXXXXX)
+"$SERVER" "$LEVELS" "$CLIENTS" "$fifo" >/dev/null 2>&1 &
+server=$!
+trap 'kill -INT $server 2>/dev/null || true' EXIT
+
+# The registry is created once the levels are cached
+while [ ! -p "$fifo" ]; do sleep 0.1; done
+
+perf c2c record -o "$OUT.data" -p "$server" -- sleep $((DURATION + 1)) >/dev/null 2>&1 &
+recorder=$!
+"$LOAD" "$fifo" "$CLIENTS" --seconds "$DURATION"
+wait "$recorder"
+
+kill -INT "$server"
+wait "$server" || true
+trap - EXIT
+
+perf c2c report -i "$OUT.data" --stdio --stats > "$OUT.txt" 2>&1
+echo "perf c2c totals for $SERVER ($CLIENTS clients, $DURATION s), full report in $OUT.txt:"
+grep -E "Load (Local|Remote) HITM|Load HITM|Shared Data Cache Lines" "$OUT.txt"
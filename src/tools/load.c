@@ -0,0 +1,106 @@
+#include "api.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+/*
+Load driver: connects many clients to a running server from one thread and
+keeps them playing random moves, so the server can be measured under load
+(perf c2c record -p <server pid> while it runs shows the cache lines the
+session table shares between threads, make bench-c2c runs exactly that and
+prints the HITM counts). Every client receives its frames
+through one poll() loop, like the event loop clients of include/api.h.
+*/
+
+#define DEFAULT_SECONDS 10
+#define DEFAULT_MOVE_MS 50
+
+static long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+int main(int argc, char **argv) {
+    int seconds = DEFAULT_SECONDS, move_ms = DEFAULT_MOVE_MS;
+    int bad_args = argc < 3;
+    for (int i = 3; i < argc && !bad_args; i++) {
+        if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--move-ms") == 0 && i + 1 < argc) move_ms = atoi(argv[++i]);
+        else bad_args = 1;
+    }
+    int n_clients = bad_args ? 0 : atoi(argv[2]);
+    if (bad_args || n_clients < 1 || seconds < 1 || move_ms < 1) {
+        fprintf(stderr, "Usage: %s <register_pipe> <clients> [--seconds N] [--move-ms N]\n", argv[0]);
+        return 1;
+    }
+
+    // Clients whose game ended may still be written to before their frames say so
+    signal(SIGPIPE, SIG_IGN);
+
+    pacman_session_t **clients = calloc(n_clients, sizeof(pacman_session_t*));
+    struct pollfd *fds = calloc(n_clients, sizeof(struct pollfd));
+    if (!clients || !fds) return 1;
+
+    // The server needs max_games >= clients, pacman_open waits for a free slot
+    int connected = 0;
+    for (int i = 0; i < n_clients; i++) {
+        char req[64], notif[64];
+        snprintf(req, sizeof(req), "/tmp/load_%d_%d_request", (int)getpid(), i);
+        snprintf(notif, sizeof(notif), "/tmp/load_%d_%d_notification", (int)getpid(), i);
+        clients[i] = pacman_open(req, notif, argv[1]);
+        if (!clients[i]) {
+            fprintf(stderr, "Client %d failed to connect\n", i);
+            break;
+        }
+        connected++;
+    }
+    printf("%d clients connected\n", connected);
+
+    const char moves[] = "WASD";
+    unsigned seed = (unsigned)getpid();
+    long long end = now_ms() + seconds * 1000LL, next_move = now_ms();
+    long total = 0;
+    int alive = connected;
+    while (alive > 0 && now_ms() < end) {
+        if (now_ms() >= next_move) {
+            for (int i = 0; i < connected; i++) {
+                if (clients[i] && pacman_request_fd(clients[i]) != -1) pacman_play(clients[i], moves[rand_r(&seed) % 4]);
+            }
+            next_move += move_ms;
+        }
+
+        for (int i = 0; i < connected; i++) {
+            fds[i].fd = clients[i] ? pacman_notification_fd(clients[i]) : -1;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        long long wait = next_move - now_ms();
+        int n = poll(fds, connected, wait > 0 ? (int)wait : 0);
+        for (int i = 0; n > 0 && i < connected; i++) {
+            if (!fds[i].revents) continue;
+            int got = pacman_poll(clients[i], 0);
+            if (got < 0) {
+                // Game over or disconnected: the client leaves the load
+                pacman_close(clients[i]);
+                clients[i] = NULL;
+                alive--;
+                continue;
+            }
+            total += got;
+        }
+    }
+
+    for (int i = 0; i < connected; i++) {
+        if (clients[i]) pacman_close(clients[i]);
+    }
+    printf("%ld frames received in %d s (%d clients still playing at the end)\n", total, seconds, alive);
+
+    free(clients);
+    free(fds);
+    return 0;
+}
@@ -0,0 +1,290 @@
+#include "board.h"
+#include "recording.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/*
+Offline replay of a server recording (--record).
+Without a session key it lists the recorded sessions; with a key it rebuilds
+the board at the requested tick by re-running move_pacman/move_ghosts from the
+level files, exactly in the order the server applied them. Records the server
+dropped (REC_GAP) end the replay there: the board after them is unknown.
+*/
+
+typedef struct {
+    const unsigned char *data;
+    size_t len;
+    size_t pos;
+} reader_t;
+
+typedef struct {
+    int type;
+    uint64_t key;
+    uint64_t tick_delta;
+    uint64_t client_id;
+    uint64_t seed;
+    char level[MAX_FILENAME];
+    uint64_t points;
+    uint64_t lost;
+    char command;
+} record_t;
+
+typedef struct {
+    uint64_t key;
+    uint64_t client_id;
+    uint64_t seed;
+    uint64_t tick;
+    int levels;
+    int plays;
+    int ended;
+    uint64_t lost;      // Records dropped by the server (REC_GAP)
+} session_info_t;
+
+static int read_varint(reader_t *r, uint64_t *value) {
+    int n = varint_decode(r->data + r->pos, r->len - r->pos, value);
+    if (n < 0) return -1;
+    r->pos += n;
+    return 0;
+}
+
+// Returns 1 when a record was read, 0 at the end of the file, -1 if corrupt
+static int read_record(reader_t *r, record_t *rec) {
+    if (r->pos >= r->len) return 0;
+    rec->type = r->data[r->pos++];
+    if (read_varint(r, &rec->key) < 0) return -1;
+    rec->tick_delta = 0;
+
+    switch (rec->type) {
+        case REC_SESSION:
+            if (read_varint(r, &rec->client_id) < 0 || read_varint(r, &rec->seed) < 0) return -1;
+            return 1;
+        case REC_LEVEL: {
+            uint64_t name_len;
+            if (read_varint(r, &rec->tick_delta) < 0 || read_varint(r, &name_len) < 0) return -1;
+            if (name_len >= MAX_FILENAME || r->pos + name_len > r->len) return -1;
+            memcpy(rec->level, r->data + r->pos, name_len);
+            rec->level[name_len] = '\0';
+            r->pos += name_len;
+            if (read_varint(r, &rec->points) < 0) return -1;
+            return 1;
+        }
+        case REC_PLAY:
+            if (read_varint(r, &rec->tick_delta) < 0 || r->pos >= r->len) return -1;
+            rec->command = (char)r->data[r->pos++];
+            return 1;
+        case REC_END:
+            if (read_varint(r, &rec->tick_delta) < 0) return -1;
+            return 1;
+        case REC_GAP:
+            if (read_varint(r, &rec->tick_delta) < 0 || read_varint(r, &rec->lost) < 0) return -1;
+            return 1;
+        default:
+            return -1;
+    }
+}
+
+static unsigned char* read_file(const char *path, size_t *len) {
+    FILE *f = fopen(path, "rb");
+    if (!f) return NULL;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    unsigned char *data = malloc(size > 0 ? size : 1);
+    if (data && fread(data, 1, size, f) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(f);
+    *len = size;
+    return data;
+}
+
+static int open_recording(reader_t *r, const char *path) {
+    r->data = read_file(path, &r->len);
+    r->pos = 0;
+    if (!r->data || r->len < 4 || memcmp(r->data, RECORDING_MAGIC, 4) != 0) {
+        fprintf(stderr, "%s is not a recording\n", path);
+        return -1;
+    }
+    r->pos = 4;
+    uint64_t version;
+    // Version 2 only added REC_GAP
+    if (read_varint(r, &version) < 0 || version < 1 || version > RECORDING_VERSION) {
+        fprintf(stderr, "Unsupported recording version\n");
+        return -1;
+    }
+    return 0;
+}
+
+static int list_sessions(reader_t *r) {
+    session_info_t *infos = NULL;
+    int n_infos = 0;
+    record_t rec;
+    int status;
+
+    while ((status = read_record(r, &rec)) > 0) {
+        session_info_t *info = NULL;
+        for (int i = 0; i < n_infos; i++) {
+            if (infos[i].key == rec.key) { info = &infos[i]; break; }
+        }
+        if (!info) {
+            session_info_t *grown = realloc(infos, (n_infos + 1) * sizeof(session_info_t));
+            if (!grown) break;
+            infos = grown;
+            info = &infos[n_infos++];
+            memset(info, 0, sizeof(*info));
+            info->key = rec.key;
+        }
+        info->tick += rec.tick_delta;
+        switch (rec.type) {
+            case REC_SESSION: info->client_id = rec.client_id; info->seed = rec.seed; break;
+            case REC_LEVEL: info->levels++; break;
+            case REC_PLAY: info->plays++; break;
+            case REC_END: info->ended = 1; break;
+            case REC_GAP: info->lost += rec.lost; break;
+        }
+    }
+
+    printf("%-8s %-10s %-20s %-8s %-8s %-8s %-8s %s\n", "KEY", "CLIENT", "SEED", "TICKS", "LEVELS", "PLAYS", "LOST", "STATE");
+    for (int i = 0; i < n_infos; i++) {
+        printf("%-8lu %-10lu %-20lu %-8lu %-8d %-8d %-8lu %s\n",
+               (unsigned long)infos[i].key, (unsigned long)infos[i].client_id,
+               (unsigned long)infos[i].seed, (unsigned long)infos[i].tick,
+               infos[i].levels, infos[i].plays, (unsigned long)infos[i].lost,
+               infos[i].ended ? "ended" : "live");
+    }
+    free(infos);
+    if (status < 0) fprintf(stderr, "Recording is truncated or corrupt\n");
+    return 0;
+}
+
+static void print_frame(board_t *board, uint64_t tick, const char *level) {
+    int points = board->n_pacmans > 0 ? board->pacmans[0].points : 0;
+    int alive = board->n_pacmans > 0 ? board->pacmans[0].alive : 0;
+    printf("Level: %s | Tick: %lu | Points: %d%s\n", level, (unsigned long)tick, points, alive ? "" : " | GAME OVER");
+
+    for (int y = 0; y < board->height; y++) {
+        for (int x = 0; x < board->width; x++) {
+            board_pos_t *cell = &board->board[y * board->width + x];
+            char out_char;
+            switch (cell->content) {
+                case 'W': out_char = '#'; break;
+                case 'P': out_char = 'C'; break;
+                case 'M': out_char = 'M'; break;
+                default:
+                    if (cell->has_dot) out_char = '.';
+                    else if (cell->has_portal) out_char = '@';
+                    else out_char = ' ';
+                    break;
+            }
+            putchar(out_char);
+        }
+        putchar('\n');
+    }
+}
+
+static int replay_session(reader_t *r, const char *levels_dir, uint64_t key, int64_t target_tick) {
+    board_t board;
+    int loaded = 0;
+    char level[MAX_FILENAME] = "";
+    uint64_t tick = 0;
+    uint64_t seed = 0;
+    int level_index = 0;     // Levels loaded so far, the server seeds each one from it
+    record_t rec;
+    int status;
+    int found = 0;
+    int gap = 0;
+
+    while ((status = read_record(r, &rec)) > 0) {
+        if (rec.key != key) continue;
+        found = 1;
+        uint64_t record_tick = tick + rec.tick_delta;
+
+        // Frame N contains every event recorded up to tick N
+        if (target_tick >= 0 && record_tick > (uint64_t)target_tick) break;
+
+        // Plays between the last record and this one were lost, so were the ticks' effects
+        if (rec.type == REC_GAP) {
+            fprintf(stderr, "Session %lu: %lu records lost after tick %lu, showing the board before them\n",
+                    (unsigned long)key, (unsigned long)rec.lost, (unsigned long)tick);
+            gap = 1;
+            break;
+        }
+
+        // Ghost ticks that happened before this record
+        while (tick < record_tick) {
+            if (loaded) move_ghosts(&board);
+            tick++;
+        }
+
+        if (rec.type == REC_SESSION) {
+            seed = rec.seed;
+        } else if (rec.type == REC_LEVEL) {
+            if (loaded) unload_level(&board);
+            if (load_level(&board, rec.level, (char*)levels_dir, 0) != 0) {
+                fprintf(stderr, "Failed to load level %s from %s\n", rec.level, levels_dir);
+                return 1;
+            }
+            if (board.n_pacmans > 0) board.pacmans[0].points = rec.points;
+            // The server seeds every level from the session seed and the level's index
+            seed_board_rng(&board, level_seed(seed, level_index++));
+            strcpy(level, rec.level);
+            loaded = 1;
+        } else if (rec.type == REC_PLAY && loaded) {
+            // Same command shape session_handler builds for OP_CODE_PLAY
+            command_t cmd = { .command = rec.command, .turns = 1 };
+            move_pacman(&board, 0, &cmd);
+        } else if (rec.type == REC_END) {
+            break;
+        }
+    }
+
+    if (!found) {
+        fprintf(stderr, "Session %lu not found in recording\n", (unsigned long)key);
+        return 1;
+    }
+    if (status < 0) fprintf(stderr, "Recording is truncated or corrupt\n");
+
+    // The recording may end before the requested tick: keep the ghosts going
+    while (loaded && !gap && target_tick >= 0 && tick < (uint64_t)target_tick) {
+        move_ghosts(&board);
+        tick++;
+    }
+
+    if (loaded) {
+        print_frame(&board, tick, level);
+        unload_level(&board);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc < 2 || argc > 5) {
+        fprintf(stderr, "Usage: %s <recording> [<levels_dir> <session_key> [tick]]\n", argv[0]);
+        return 1;
+    }
+
+    // Engine debug output is not interesting here
+    open_debug_file("/dev/null");
+
+    reader_t reader;
+    if (open_recording(&reader, argv[1]) != 0) return 1;
+
+    int ret;
+    if (argc == 2) {
+        ret = list_sessions(&reader);
+    } else if (argc >= 4) {
+        uint64_t key = strtoull(argv[3], NULL, 10);
+        int64_t tick = (argc == 5) ? atoll(argv[4]) : -1;
+        ret = replay_session(&reader, argv[2], key, tick);
+    } else {
+        fprintf(stderr, "Missing session key\n");
+        ret = 1;
+    }
+
+    free((void*)reader.data);
+    close_debug_file();
+    return ret;
+}